@@ -0,0 +1,156 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atlas.h"
+
+struct roi_map {
+	tex_coord_func texfunc;
+	const struct roi *roi;
+	float xscale, yscale, xoffs, yoffs;
+};
+
+/*
+ * Vertex positions are normalised over the whole atlas, so write the
+ * ROI's grid into its sub-rectangle, and look up texture coordinates
+ * for the matching point of the ROI.
+ */
+static void build_roi_mesh(GLfloat *dst, const struct roi_map *map)
+{
+	const struct roi *roi = map->roi;
+	unsigned int row, col;
+	double xstep = 1.0 / (roi->xpoints - 1);
+	double ystep = 1.0 / (roi->ypoints - 1);
+
+	for (row = 0; row < roi->ypoints; row++) {
+		float v = row * ystep;
+		for (col = 0; col < roi->xpoints; col++, dst += 4) {
+			float u = col * xstep;
+			float x = roi->x + u * roi->w;
+			float y = roi->y + v * roi->h;
+
+			dst[0] = map->xoffs + u * map->xscale;
+			dst[1] = map->yoffs + v * map->yscale;
+
+			if (map->texfunc) {
+				map->texfunc(x, y, &dst[2], &dst[3]);
+			} else {
+				dst[2] = x;
+				dst[3] = y;
+			}
+		}
+	}
+}
+
+void atlas_free(struct atlas *atlas)
+{
+	if (!atlas)
+		return;
+
+	if (atlas->mesh.mhandle)
+		glDeleteBuffers(1, &atlas->mesh.mhandle);
+	if (atlas->mesh.ihandle)
+		glDeleteBuffers(1, &atlas->mesh.ihandle);
+	free(atlas->mesh.mesh);
+	free(atlas->mesh.indices);
+	free(atlas);
+}
+
+struct atlas *atlas_build(const struct roi *rois, unsigned int nrois, tex_coord_func texfunc,
+			  enum mesh_format format)
+{
+	unsigned int i, width = 0, height = 0, nverts = 0, nindices = 0;
+	unsigned int vbase = 0, ioffs = 0;
+	struct atlas *atlas;
+
+	if (!nrois || nrois > ATLAS_MAX_ROIS) {
+		fprintf(stderr, "Invalid number of ROIs: %d\n", nrois);
+		return NULL;
+	}
+
+	for (i = 0; i < nrois; i++) {
+		if (rois[i].xpoints < 2 || rois[i].ypoints < 2 ||
+		    !rois[i].width || !rois[i].height) {
+			fprintf(stderr, "ROI %d is empty\n", i);
+			return NULL;
+		}
+
+		if (rois[i].width > width)
+			width = rois[i].width;
+		height += rois[i].height;
+
+		nverts += rois[i].xpoints * rois[i].ypoints;
+		nindices += ((rois[i].ypoints - 1) * ((rois[i].xpoints * 2) + 2)) - 2;
+	}
+	/* Two degenerate indices join each strip to the next */
+	nindices += (nrois - 1) * 2;
+
+	if (nverts > 32767) {
+		fprintf(stderr, "Too many vertices for GLshort indices: %d\n", nverts);
+		return NULL;
+	}
+
+	atlas = calloc(1, sizeof(*atlas));
+	if (!atlas)
+		return NULL;
+
+	atlas->nrois = nrois;
+	memcpy(atlas->rois, rois, sizeof(*rois) * nrois);
+	atlas->fbo.width = width;
+	atlas->fbo.height = height;
+
+	atlas->mesh.nverts = nverts * 4;
+	atlas->mesh.mesh = malloc(sizeof(*atlas->mesh.mesh) * atlas->mesh.nverts);
+	atlas->mesh.nindices = nindices;
+	atlas->mesh.indices = malloc(sizeof(*atlas->mesh.indices) * nindices);
+	if (!atlas->mesh.mesh || !atlas->mesh.indices) {
+		atlas_free(atlas);
+		return NULL;
+	}
+
+	for (i = 0, height = 0; i < nrois; i++) {
+		const struct roi *roi = &rois[i];
+		struct roi_map map = {
+			.texfunc = texfunc,
+			.roi = roi,
+			.xoffs = 0.0f,
+			.yoffs = (float)height / atlas->fbo.height,
+			.xscale = (float)roi->width / atlas->fbo.width,
+			.yscale = (float)roi->height / atlas->fbo.height,
+		};
+		unsigned int j, n;
+		GLshort *idx;
+
+		atlas->rects[i] = (struct viewport){ 0, height, roi->width, roi->height };
+		height += roi->height;
+
+		build_roi_mesh(atlas->mesh.mesh + vbase * 4, &map);
+
+		idx = mesh_build_indices(roi->xpoints, roi->ypoints, &n);
+		if (!idx) {
+			atlas_free(atlas);
+			return NULL;
+		}
+
+		if (i > 0) {
+			atlas->mesh.indices[ioffs] = atlas->mesh.indices[ioffs - 1];
+			atlas->mesh.indices[ioffs + 1] = idx[0] + vbase;
+			ioffs += 2;
+		}
+
+		for (j = 0; j < n; j++) {
+			atlas->mesh.indices[ioffs++] = idx[j] + vbase;
+		}
+		free(idx);
+
+		vbase += roi->xpoints * roi->ypoints;
+	}
+
+	atlas->mesh.format = format;
+	mesh_upload(&atlas->mesh);
+
+	return atlas;
+}
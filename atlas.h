@@ -0,0 +1,47 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#ifndef __ATLAS_H__
+#define __ATLAS_H__
+
+#include <GLES2/gl2.h>
+
+#include "mesh.h"
+#include "types.h"
+
+#define ATLAS_MAX_ROIS 8
+
+/*
+ * A region of interest. x, y, w, h are in the normalised (0-1) image
+ * space which the tex_coord_func maps to input texture coordinates -
+ * i.e. the undistorted view when using brown(), or input texture
+ * coordinates directly with no tex_coord_func.
+ */
+struct roi {
+	float x, y, w, h;
+	/* Output size in the atlas, in pixels */
+	unsigned int width, height;
+	/* Distortion mesh density over the region */
+	unsigned int xpoints, ypoints;
+};
+
+/*
+ * Several ROIs rendered with a single draw into one FBO. The ROIs are
+ * stacked top to bottom, and the sub-grid meshes for all of them are
+ * joined into one triangle strip.
+ */
+struct atlas {
+	struct fbo fbo;
+	struct mesh mesh;
+
+	unsigned int nrois;
+	struct roi rois[ATLAS_MAX_ROIS];
+	/* Where each ROI ended up in the FBO, in pixels */
+	struct viewport rects[ATLAS_MAX_ROIS];
+};
+
+struct atlas *atlas_build(const struct roi *rois, unsigned int nrois, tex_coord_func texfunc,
+			  enum mesh_format format);
+void atlas_free(struct atlas *atlas);
+
+#endif /* __ATLAS_H__ */
@@ -0,0 +1,19 @@
+#version 100
+#ifdef MEDIUMP
+#define PREC mediump
+#else
+#define PREC highp
+#endif
+precision PREC float;
+varying highp vec2 v_TexCoord;
+uniform sampler2D tex;
+uniform sampler2D prev;
+uniform float alpha;
+
+void main()
+{
+	vec3 c = texture2D(tex, v_TexCoord).rgb;
+	vec3 bg = texture2D(prev, v_TexCoord).rgb;
+
+	gl_FragColor = vec4(mix(bg, c, alpha), 1.0);
+}
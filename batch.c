@@ -0,0 +1,384 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include <GLES2/gl2.h>
+
+#include "batch.h"
+#include "texture.h"
+
+#define MAX_PASSES 16
+
+extern volatile bool should_exit;
+
+enum batch_stage {
+	STAGE_DEQUEUE = 0,
+	STAGE_DRAW,
+	STAGE_READBACK,
+	STAGE_WRITE,
+	N_STAGES,
+};
+
+static const char *stage_names[] = {
+	[STAGE_DEQUEUE] = "dequeue",
+	[STAGE_DRAW] = "draw",
+	[STAGE_READBACK] = "readback",
+	[STAGE_WRITE] = "write",
+};
+
+static long timespec_nanos(struct timespec a, struct timespec b)
+{
+	return (b.tv_sec - a.tv_sec) * 1000000000L + (b.tv_nsec - a.tv_nsec);
+}
+
+static int cmpstringp(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static int append_input(char ***files, unsigned int *n, unsigned int *size, const char *path)
+{
+	if (*n == *size) {
+		unsigned int newsize = *size ? *size * 2 : 64;
+		char **tmp = realloc(*files, sizeof(**files) * newsize);
+		if (!tmp)
+			return -1;
+		*files = tmp;
+		*size = newsize;
+	}
+
+	(*files)[*n] = strdup(path);
+	if (!(*files)[*n])
+		return -1;
+	(*n)++;
+
+	return 0;
+}
+
+static int list_directory(const char *path, char ***files, unsigned int *n, unsigned int *size)
+{
+	char buf[PATH_MAX];
+	struct dirent *ent;
+	struct stat st;
+	DIR *dir = opendir(path);
+	if (!dir) {
+		fprintf(stderr, "Couldn't open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	while ((ent = readdir(dir))) {
+		snprintf(buf, sizeof(buf), "%s/%s", path, ent->d_name);
+		if (stat(buf, &st) || !S_ISREG(st.st_mode))
+			continue;
+
+		if (append_input(files, n, size, buf)) {
+			closedir(dir);
+			return -1;
+		}
+	}
+	closedir(dir);
+
+	qsort(*files, *n, sizeof(**files), cmpstringp);
+
+	return 0;
+}
+
+static int list_file(const char *path, char ***files, unsigned int *n, unsigned int *size)
+{
+	char buf[PATH_MAX];
+	FILE *fp = fopen(path, "r");
+	if (!fp) {
+		fprintf(stderr, "Couldn't open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	while (fgets(buf, sizeof(buf), fp)) {
+		buf[strcspn(buf, "\r\n")] = '\0';
+		if (!buf[0] || buf[0] == '#')
+			continue;
+
+		if (append_input(files, n, size, buf)) {
+			fclose(fp);
+			return -1;
+		}
+	}
+	fclose(fp);
+
+	return 0;
+}
+
+void batch_free_inputs(char **files, unsigned int nfiles)
+{
+	unsigned int i;
+
+	for (i = 0; i < nfiles; i++)
+		free(files[i]);
+	free(files);
+}
+
+char **batch_list_inputs(const char *path, unsigned int *nfiles)
+{
+	char **files = NULL;
+	unsigned int n = 0, size = 0;
+	struct stat st;
+	int ret;
+
+	if (stat(path, &st)) {
+		fprintf(stderr, "Couldn't stat %s: %s\n", path, strerror(errno));
+		return NULL;
+	}
+
+	if (S_ISDIR(st.st_mode))
+		ret = list_directory(path, &files, &n, &size);
+	else
+		ret = list_file(path, &files, &n, &size);
+
+	if (ret || !n) {
+		fprintf(stderr, "No input frames found in %s\n", path);
+		batch_free_inputs(files, n);
+		return NULL;
+	}
+
+	*nfiles = n;
+	return files;
+}
+
+struct pass_result {
+	long time;
+	unsigned int max_diff;
+	unsigned int mismatches;
+	char name[32];
+};
+
+/* Returns the largest per-channel difference, or -1 if the reference is unusable */
+static int compare_reference(const char *fname, const struct texture *out)
+{
+	unsigned int row, col, c, pitch;
+	int max_diff = 0;
+	struct texture *ref = texture_load(fname);
+	if (!ref)
+		return -1;
+
+	if (ref->ncmp != 3 || ref->width != out->width || ref->height != out->height) {
+		fprintf(stderr, "%s: reference is %dx%d (%d cmp), output is %dx%d\n", fname,
+			ref->width, ref->height, ref->ncmp, out->width, out->height);
+		texture_free(ref);
+		return -1;
+	}
+
+	pitch = ((ref->width * 3) + 3) & ~3;
+	for (row = 0; row < out->height; row++) {
+		const unsigned char *a = (unsigned char *)out->data + row * out->width * 4;
+		const unsigned char *b = (unsigned char *)ref->data + row * pitch;
+
+		for (col = 0; col < out->width; col++, a += 4, b += 3) {
+			for (c = 0; c < 3; c++) {
+				int diff = abs((int)a[c] - (int)b[c]);
+				if (diff > max_diff)
+					max_diff = diff;
+			}
+		}
+	}
+
+	texture_free(ref);
+	return max_diff;
+}
+
+static int write_report(const char *file, unsigned int frames, long total,
+			const long *stage_time, const struct pass_result *passes,
+			unsigned int npasses, const struct batch_opts *opts, bool passed)
+{
+	unsigned int i;
+	FILE *fp = fopen(file, "w");
+	if (!fp) {
+		fprintf(stderr, "Couldn't open %s: %s\n", file, strerror(errno));
+		return -1;
+	}
+
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"frames\": %u,\n", frames);
+	fprintf(fp, "  \"total_ms\": %.3f,\n", total / 1000000.0);
+	fprintf(fp, "  \"fps\": %.3f,\n", frames ? frames * 1000000000.0 / total : 0.0);
+	fprintf(fp, "  \"stages_ms_per_frame\": {");
+	for (i = 0; i < N_STAGES; i++) {
+		fprintf(fp, "%s\"%s\": %.4f", i ? ", " : " ", stage_names[i],
+			frames ? stage_time[i] / (frames * 1000000.0) : 0.0);
+	}
+	fprintf(fp, " },\n");
+	fprintf(fp, "  \"passes\": [\n");
+	for (i = 0; i < npasses; i++) {
+		fprintf(fp, "    { \"pass\": \"%s\"", passes[i].name);
+		if (opts->pass_timing) {
+			fprintf(fp, ", \"ms_per_frame\": %.4f",
+				frames ? passes[i].time / (frames * 1000000.0) : 0.0);
+		}
+		if (opts->refdir) {
+			fprintf(fp, ", \"max_diff\": %u, \"mismatched_frames\": %u",
+				passes[i].max_diff, passes[i].mismatches);
+		}
+		fprintf(fp, " }%s\n", i + 1 < npasses ? "," : "");
+	}
+	fprintf(fp, "  ],\n");
+	if (opts->refdir) {
+		fprintf(fp, "  \"tolerance\": %u,\n", opts->tolerance);
+	}
+	fprintf(fp, "  \"result\": \"%s\"\n", passed ? "pass" : "fail");
+	fprintf(fp, "}\n");
+
+	return fclose(fp) ? -1 : 0;
+}
+
+int batch_run(struct feed *feed, struct drawcall **dcs, unsigned int ndcs,
+	      const struct batch_opts *opts)
+{
+	long stage_time[N_STAGES] = { 0 };
+	struct pass_result passes[MAX_PASSES] = {{ 0 }};
+	struct timespec start, end, a, b;
+	unsigned int frame = 0, i;
+	struct texture out = { 0 };
+	bool readback = opts->outdir || opts->refdir;
+	bool passed = true;
+	size_t maxsize = 0;
+	long total;
+	int ret = 0;
+
+	if (ndcs > MAX_PASSES) {
+		fprintf(stderr, "Too many passes (%d)\n", ndcs);
+		return -1;
+	}
+
+	for (i = 0; i < ndcs; i++) {
+		size_t size = dcs[i]->fbo.width * dcs[i]->fbo.height * 4;
+		if (size > maxsize)
+			maxsize = size;
+
+		/* Outputs are keyed by name, so the draw order doesn't matter */
+		if (dcs[i]->name[0])
+			snprintf(passes[i].name, sizeof(passes[i].name), "%s", dcs[i]->name);
+		else
+			snprintf(passes[i].name, sizeof(passes[i].name), "pass%u", i);
+	}
+
+	out.ncmp = 4;
+	out.data = malloc(maxsize ? maxsize : 1);
+	if (!out.data)
+		return -1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (!should_exit) {
+		clock_gettime(CLOCK_MONOTONIC, &a);
+		ret = feed->dequeue(feed);
+		if (ret == FEED_END) {
+			ret = 0;
+			break;
+		} else if (ret) {
+			fprintf(stderr, "Failed dequeueing frame %d\n", frame);
+			break;
+		}
+		if (opts->pass_timing)
+			glFinish();
+		clock_gettime(CLOCK_MONOTONIC, &b);
+		stage_time[STAGE_DEQUEUE] += timespec_nanos(a, b);
+
+		for (i = 0; i < ndcs; i++) {
+			a = b;
+			drawcall_draw(feed, dcs[i]);
+			if (opts->pass_timing)
+				glFinish();
+			clock_gettime(CLOCK_MONOTONIC, &b);
+			passes[i].time += timespec_nanos(a, b);
+			stage_time[STAGE_DRAW] += timespec_nanos(a, b);
+		}
+		/* Otherwise the readback is the only sync with the GPU */
+		if (!opts->pass_timing && !readback)
+			glFlush();
+
+		for (i = 0; i < ndcs && readback; i++) {
+			struct fbo *fbo = &dcs[i]->fbo;
+			char fname[PATH_MAX];
+
+			if (!fbo->handle)
+				continue;
+
+			a = b;
+			fbo_readback(fbo, out.data);
+			out.width = fbo->width;
+			out.height = fbo->height;
+			clock_gettime(CLOCK_MONOTONIC, &b);
+			stage_time[STAGE_READBACK] += timespec_nanos(a, b);
+
+			if (opts->outdir) {
+				a = b;
+				snprintf(fname, sizeof(fname), "%s/%06u_%s.ppm", opts->outdir, frame, passes[i].name);
+				ret = texture_save(fname, &out);
+				clock_gettime(CLOCK_MONOTONIC, &b);
+				stage_time[STAGE_WRITE] += timespec_nanos(a, b);
+				if (ret)
+					break;
+			}
+
+			if (opts->refdir) {
+				int diff;
+
+				snprintf(fname, sizeof(fname), "%s/%06u_%s.ppm", opts->refdir, frame, passes[i].name);
+				diff = compare_reference(fname, &out);
+				if (diff < 0 || diff > opts->tolerance) {
+					fprintf(stderr, "Frame %u pass %s doesn't match %s (diff %d)\n",
+						frame, passes[i].name, fname, diff);
+					passes[i].mismatches++;
+					passed = false;
+				}
+				if (diff > (int)passes[i].max_diff)
+					passes[i].max_diff = diff;
+				clock_gettime(CLOCK_MONOTONIC, &b);
+			}
+		}
+
+		feed->queue(feed);
+		frame++;
+
+		if (ret)
+			break;
+	}
+	glFinish();
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	free(out.data);
+
+	total = timespec_nanos(start, end);
+	printf("Processed %u frames in %.3f s: %.3f fps\n", frame,
+	       total / 1000000000.0, frame ? frame * 1000000000.0 / total : 0.0);
+	if (frame) {
+		for (i = 0; i < N_STAGES; i++) {
+			printf("  %-10s %10.3f ms/frame\n", stage_names[i],
+			       stage_time[i] / (frame * 1000000.0));
+		}
+		for (i = 0; i < ndcs && opts->pass_timing; i++) {
+			printf("    %-20s %10.3f ms/frame\n", passes[i].name,
+			       passes[i].time / (frame * 1000000.0));
+		}
+	}
+
+	if (opts->refdir) {
+		printf("Reference comparison %s\n", passed ? "passed" : "FAILED");
+	}
+
+	if (opts->report && write_report(opts->report, frame, total, stage_time,
+					 passes, ndcs, opts, passed && !ret)) {
+		ret = -1;
+	}
+
+	if (!ret && !passed)
+		ret = 1;
+
+	return ret;
+}
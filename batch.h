@@ -0,0 +1,49 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include "drawcall.h"
+#include "feed.h"
+
+/*
+ * Build a list of input frames. path is either a directory, in which
+ * case all the regular files in it are used in name order, or a text
+ * file listing one frame per line.
+ */
+char **batch_list_inputs(const char *path, unsigned int *nfiles);
+void batch_free_inputs(char **files, unsigned int nfiles);
+
+struct batch_opts {
+	/*
+	 * Write each FBO pass output here, as <frame>_<name>.ppm where name
+	 * is the drawcall's name (or pass<n> for unnamed ones)
+	 */
+	const char *outdir;
+	/*
+	 * Compare each FBO pass output against the image of the same name
+	 * in refdir. A frame fails if any channel differs by more than
+	 * tolerance.
+	 */
+	const char *refdir;
+	unsigned int tolerance;
+	/* Write a JSON summary of timing and comparison results here */
+	const char *report;
+	/*
+	 * Wait for the GPU after every pass, to time them individually.
+	 * Otherwise the GPU is left to run ahead, and its time mostly shows
+	 * up in the readback stage.
+	 */
+	bool pass_timing;
+};
+
+/*
+ * Run every frame from feed through the drawcalls as fast as possible,
+ * without presenting anything. A timing summary is printed at the end.
+ * Returns non-zero on error, or if any output didn't match the reference.
+ */
+int batch_run(struct feed *feed, struct drawcall **dcs, unsigned int ndcs,
+	      const struct batch_opts *opts);
+
+#endif /* __BATCH_H__ */
@@ -0,0 +1,337 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ *
+ * Microbenchmarks for the CPU-side startup costs: mesh generation and
+ * texture loading. Results are printed as JSON so runs can be compared
+ * across commits.
+ */
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#include <GLES2/gl2.h>
+
+#include "distort.h"
+#include "mesh.h"
+#include "texture.h"
+
+#define DEFAULT_WARMUP 3
+#define DEFAULT_REPS 20
+#define MAX_REPS 1000
+
+struct bench {
+	const char *name;
+	const char *params;
+	void (*setup)(struct bench *b);
+	void (*run)(struct bench *b);
+	/* Free whatever run() produced */
+	void (*release)(struct bench *b);
+	void (*cleanup)(struct bench *b);
+
+	unsigned int x, y, ncmp;
+	char path[PATH_MAX];
+	void *result;
+};
+
+static int cycles_fd = -1;
+static unsigned int warmup = DEFAULT_WARMUP, reps = DEFAULT_REPS;
+
+static void cycles_init(void)
+{
+	struct perf_event_attr attr = {
+		.type = PERF_TYPE_HARDWARE,
+		.size = sizeof(attr),
+		.config = PERF_COUNT_HW_CPU_CYCLES,
+		.disabled = 1,
+		.exclude_kernel = 1,
+		.exclude_hv = 1,
+	};
+
+	cycles_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	if (cycles_fd < 0) {
+		fprintf(stderr, "perf_event_open: %s, not counting cycles\n", strerror(errno));
+	}
+}
+
+static void cycles_start(void)
+{
+	if (cycles_fd < 0)
+		return;
+
+	ioctl(cycles_fd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(cycles_fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+static uint64_t cycles_stop(void)
+{
+	uint64_t count = 0;
+
+	if (cycles_fd < 0)
+		return 0;
+
+	ioctl(cycles_fd, PERF_EVENT_IOC_DISABLE, 0);
+	if (read(cycles_fd, &count, sizeof(count)) != sizeof(count))
+		return 0;
+
+	return count;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void run_mesh_build(struct bench *b)
+{
+	unsigned int nelems;
+
+	b->result = mesh_build(b->x, b->y, brown, &nelems);
+}
+
+static void run_mesh_build_parallel(struct bench *b)
+{
+	unsigned int nelems;
+
+	b->result = mesh_build_parallel(b->x, b->y, brown_row, 0, &nelems);
+}
+
+static void run_mesh_build_indices(struct bench *b)
+{
+	unsigned int nindices;
+
+	b->result = mesh_build_indices(b->x, b->y, &nindices);
+}
+
+static void free_result(struct bench *b)
+{
+	free(b->result);
+	b->result = NULL;
+}
+
+/* Stops the compiler throwing away the checksum */
+static volatile uint32_t checksum;
+
+/*
+ * texture_load() may just mmap() the file, so read every pixel (as the
+ * upload would) to make the mmap and copying paths comparable
+ */
+static void run_texture_load(struct bench *b)
+{
+	struct texture *tex = texture_load(b->path);
+	uint32_t sum = 0, word;
+	size_t i;
+
+	b->result = tex;
+	if (!tex)
+		return;
+
+	/* Mapped data starts after the header, so it may not be aligned */
+	for (i = 0; i + 4 <= tex->datalen; i += 4) {
+		memcpy(&word, tex->data + i, 4);
+		sum += word;
+	}
+	checksum = sum;
+}
+
+static void free_texture(struct bench *b)
+{
+	texture_free(b->result);
+	b->result = NULL;
+}
+
+static char tmpdir[] = "/tmp/camera-bench-XXXXXX";
+
+static void setup_image(struct bench *b)
+{
+	struct texture tex = {
+		.width = b->x,
+		.height = b->y,
+		.ncmp = b->ncmp,
+	};
+	size_t i;
+
+	tex.datalen = (((tex.width * tex.ncmp) + 3) & ~3) * tex.height;
+	tex.data = malloc(tex.datalen);
+	if (!tex.data) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < tex.datalen; i++)
+		tex.data[i] = i * 7;
+
+	snprintf(b->path, sizeof(b->path), "%s/%ux%u.%s", tmpdir, b->x, b->y,
+		 tex.ncmp == 1 ? "pgm" : "ppm");
+	if (texture_save(b->path, &tex)) {
+		exit(EXIT_FAILURE);
+	}
+	free(tex.data);
+}
+
+static void cleanup_image(struct bench *b)
+{
+	unlink(b->path);
+}
+
+#define MESH_BENCH(_n) \
+	{ "mesh_build", #_n "x" #_n, NULL, run_mesh_build, free_result, NULL, _n, _n }
+#define PARALLEL_MESH_BENCH(_n) \
+	{ "mesh_build_parallel", #_n "x" #_n, NULL, run_mesh_build_parallel, free_result, NULL, _n, _n }
+#define INDICES_BENCH(_n) \
+	{ "mesh_build_indices", #_n "x" #_n, NULL, run_mesh_build_indices, free_result, NULL, _n, _n }
+#define TEXTURE_BENCH(_fmt, _ncmp, _x, _y) \
+	{ "texture_load_" _fmt, #_x "x" #_y, setup_image, run_texture_load, free_texture, \
+	  cleanup_image, _x, _y, _ncmp }
+
+static struct bench benches[] = {
+	MESH_BENCH(16),
+	MESH_BENCH(32),
+	MESH_BENCH(64),
+	MESH_BENCH(128),
+	MESH_BENCH(256),
+	PARALLEL_MESH_BENCH(16),
+	PARALLEL_MESH_BENCH(32),
+	PARALLEL_MESH_BENCH(64),
+	PARALLEL_MESH_BENCH(128),
+	PARALLEL_MESH_BENCH(256),
+	PARALLEL_MESH_BENCH(1024),
+	INDICES_BENCH(16),
+	INDICES_BENCH(32),
+	INDICES_BENCH(64),
+	INDICES_BENCH(128),
+	/* Indices are GLshort, so this is as dense as it gets */
+	INDICES_BENCH(181),
+	TEXTURE_BENCH("pgm", 1, 320, 240),
+	TEXTURE_BENCH("pgm", 1, 640, 480),
+	TEXTURE_BENCH("pgm", 1, 1280, 720),
+	TEXTURE_BENCH("pgm", 1, 1920, 1080),
+	/* Rows aren't 4-byte aligned, so these take the repacking path */
+	TEXTURE_BENCH("pgm", 1, 638, 478),
+	TEXTURE_BENCH("ppm", 3, 640, 480),
+	TEXTURE_BENCH("ppm", 3, 1918, 1080),
+};
+#define N_BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+static void run_bench(struct bench *b, bool last)
+{
+	static uint64_t times[MAX_REPS], cycles[MAX_REPS];
+	uint64_t start, total = 0;
+	unsigned int i;
+
+	if (b->setup)
+		b->setup(b);
+
+	for (i = 0; i < warmup; i++) {
+		b->run(b);
+		b->release(b);
+	}
+
+	for (i = 0; i < reps; i++) {
+		start = now_ns();
+		cycles_start();
+		b->run(b);
+		cycles[i] = cycles_stop();
+		times[i] = now_ns() - start;
+		total += times[i];
+
+		if (!b->result) {
+			fprintf(stderr, "%s %s failed\n", b->name, b->params);
+			exit(EXIT_FAILURE);
+		}
+		b->release(b);
+	}
+
+	if (b->cleanup)
+		b->cleanup(b);
+
+	qsort(times, reps, sizeof(times[0]), cmp_u64);
+	qsort(cycles, reps, sizeof(cycles[0]), cmp_u64);
+
+	printf("    { \"name\": \"%s\", \"params\": \"%s\", \"reps\": %u, "
+	       "\"min_ns\": %llu, \"median_ns\": %llu, \"mean_ns\": %llu",
+	       b->name, b->params, reps,
+	       (unsigned long long)times[0],
+	       (unsigned long long)times[reps / 2],
+	       (unsigned long long)(total / reps));
+	if (cycles_fd >= 0)
+		printf(", \"median_cycles\": %llu", (unsigned long long)cycles[reps / 2]);
+	printf(" }%s\n", last ? "" : ",");
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-w warmup] [-n reps] [filter]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *filter = NULL;
+	unsigned int i, nrun = 0, done = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "w:n:h")) != -1) {
+		switch (opt) {
+		case 'w':
+			warmup = atoi(optarg);
+			break;
+		case 'n':
+			reps = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+	if (optind < argc)
+		filter = argv[optind];
+
+	if (reps < 1 || reps > MAX_REPS) {
+		fprintf(stderr, "reps must be between 1 and %d\n", MAX_REPS);
+		return EXIT_FAILURE;
+	}
+
+	if (!mkdtemp(tmpdir)) {
+		fprintf(stderr, "mkdtemp: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	cycles_init();
+	distort_set_size(640, 480);
+
+	for (i = 0; i < N_BENCHES; i++) {
+		if (!filter || strstr(benches[i].name, filter))
+			nrun++;
+	}
+
+	printf("{\n  \"warmup\": %u,\n  \"cycles\": %s,\n  \"results\": [\n",
+	       warmup, cycles_fd >= 0 ? "true" : "false");
+	for (i = 0; i < N_BENCHES; i++) {
+		if (filter && !strstr(benches[i].name, filter))
+			continue;
+
+		run_bench(&benches[i], ++done == nrun);
+	}
+	printf("  ]\n}\n");
+
+	rmdir(tmpdir);
+
+	return EXIT_SUCCESS;
+}
@@ -28,7 +28,11 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "interface/mmal/mmal.h"
 #include "interface/mmal/mmal_logging.h"
@@ -40,6 +44,7 @@
 
 #include "cameracontrol.h"
 #include "camera.h"
+#include "trace.h"
 
 #define MMAL_CAMERA_PREVIEW_PORT 0
 #define MMAL_CAMERA_VIDEO_PORT 1
@@ -126,10 +131,34 @@ struct camera {
 
 	uint32_t width, height;
 	unsigned int fps;
+	/* Sized in the camera config, growing past it needs a restart */
+	uint32_t max_width, max_height;
+	unsigned int sensor_mode;
+
+	/*
+	 * Parameter changes are applied by the control thread, diffed
+	 * against what was last sent. requested is protected by lock.
+	 */
+	pthread_t control_thread;
+	bool control_running;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool dirty, stop;
+	RASPICAM_CAMERA_PARAMETERS requested;
+	RASPICAM_CAMERA_PARAMETERS applied;
+
+	/*
+	 * CLOCK_MONOTONIC minus STC, in us: the smallest difference seen in
+	 * the frame callback, so it also includes the pipeline's minimum
+	 * latency. INT64_MAX until the first frame.
+	 */
+	int64_t stc_offset;
 };
 
 struct camera_buffer *camera_dequeue_buffer(struct camera *camera)
 {
+	MMAL_BUFFER_HEADER_T *hdr;
+	int64_t offset;
 	struct camera_buffer *buf = malloc(sizeof(*buf));
 	if (!buf)
 		return buf;
@@ -141,7 +170,14 @@ struct camera_buffer *camera_dequeue_buffer(struct camera *camera)
 		return NULL;
 	}
 
-	buf->egl_buf = ((MMAL_BUFFER_HEADER_T *)buf->hnd)->data;
+	hdr = buf->hnd;
+	buf->egl_buf = hdr->data;
+
+	offset = __atomic_load_n(&camera->stc_offset, __ATOMIC_RELAXED);
+	if (hdr->pts != MMAL_TIME_UNKNOWN && offset != INT64_MAX)
+		buf->timestamp = (hdr->pts + offset) * 1000;
+	else
+		buf->timestamp = 0;
 
 	return buf;
 }
@@ -163,8 +199,19 @@ void camera_queue_buffer(struct camera *camera, struct camera_buffer *buf)
 static void camera_frame_callback(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buf)
 {
 	struct camera *camera = (struct camera *)port->userdata;
-
+	struct timespec now;
+	int64_t offset;
+
+	trace_begin("camera_frame_callback");
+	if (buf->pts != MMAL_TIME_UNKNOWN) {
+		/* This is the only writer */
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		offset = now.tv_sec * 1000000LL + now.tv_nsec / 1000 - buf->pts;
+		if (offset < __atomic_load_n(&camera->stc_offset, __ATOMIC_RELAXED))
+			__atomic_store_n(&camera->stc_offset, offset, __ATOMIC_RELAXED);
+	}
 	mmal_queue_put(camera->pool->ready_queue, buf);
+	trace_end("camera_frame_callback");
 }
 
 static void camera_control_callback(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buf) {
@@ -172,8 +219,65 @@ static void camera_control_callback(MMAL_PORT_T *port, MMAL_BUFFER_HEADER_T *buf
 	mmal_buffer_header_release(buf);
 }
 
+static void *camera_control_thread(void *arg)
+{
+	struct camera *camera = (struct camera *)arg;
+	RASPICAM_CAMERA_PARAMETERS params;
+	int ret;
+
+	pthread_mutex_lock(&camera->lock);
+	while (1) {
+		while (!camera->dirty && !camera->stop)
+			pthread_cond_wait(&camera->cond, &camera->lock);
+
+		if (camera->stop)
+			break;
+
+		params = camera->requested;
+		camera->dirty = false;
+		pthread_mutex_unlock(&camera->lock);
+
+		/* Each set is a round-trip to the GPU, so don't hold the lock */
+		/* Only what was actually set is marked applied, the rest is retried next time */
+		ret = raspicamcontrol_set_changed_parameters(camera->component, &camera->applied, &params);
+		if (ret != 0)
+			fprintf(stderr, "Setting camera parameters failed: %d\n", ret);
+
+		pthread_mutex_lock(&camera->lock);
+	}
+	pthread_mutex_unlock(&camera->lock);
+
+	return NULL;
+}
+
+void camera_set_parameters(struct camera *camera, const RASPICAM_CAMERA_PARAMETERS *params)
+{
+	pthread_mutex_lock(&camera->lock);
+	camera->requested = *params;
+	camera->dirty = true;
+	pthread_cond_signal(&camera->cond);
+	pthread_mutex_unlock(&camera->lock);
+}
+
+void camera_get_parameters(struct camera *camera, RASPICAM_CAMERA_PARAMETERS *params)
+{
+	pthread_mutex_lock(&camera->lock);
+	*params = camera->requested;
+	pthread_mutex_unlock(&camera->lock);
+}
+
 void camera_exit(struct camera *camera)
 {
+	if (camera->control_running) {
+		pthread_mutex_lock(&camera->lock);
+		camera->stop = true;
+		pthread_cond_signal(&camera->cond);
+		pthread_mutex_unlock(&camera->lock);
+		pthread_join(camera->control_thread, NULL);
+	}
+	pthread_cond_destroy(&camera->cond);
+	pthread_mutex_destroy(&camera->lock);
+
 	if (camera->port->is_enabled)
 		mmal_port_disable(camera->port);
 	buffer_pool_cleanup(camera->pool);
@@ -181,15 +285,172 @@ void camera_exit(struct camera *camera)
 	free(camera);
 }
 
+static int camera_commit_format(struct camera *camera)
+{
+	MMAL_ES_FORMAT_T *format = camera->port->format;
+	MMAL_PORT_T *ports[2];
+	MMAL_STATUS_T ret;
+	int i;
+
+	ports[0] = camera->component->output[MMAL_CAMERA_VIDEO_PORT];
+	ports[1] = camera->component->output[MMAL_CAMERA_CAPTURE_PORT];
+
+	format->encoding = MMAL_ENCODING_OPAQUE;
+	format->encoding_variant = MMAL_ENCODING_I420;
+	format->es->video.width = camera->width;
+	format->es->video.height = camera->height;
+	format->es->video.crop.x = 0;
+	format->es->video.crop.y = 0;
+	format->es->video.crop.width = camera->width;
+	format->es->video.crop.height = camera->height;
+	format->es->video.frame_rate.num = camera->fps;
+	format->es->video.frame_rate.den = 1;
+	ret = mmal_port_format_commit(camera->port);
+	if (ret != MMAL_SUCCESS)
+	{
+		fprintf(stderr, "Couldn't set preview port format: %d\n", ret);
+		return -1;
+	}
+
+	for (i = 0; i < 2; i++) {
+		mmal_format_full_copy(ports[i]->format, camera->port->format);
+		ret = mmal_port_format_commit(ports[i]);
+		if (ret != MMAL_SUCCESS)
+		{
+			fprintf(stderr, "Couldn't copy format to port %d: %d\n", i, ret);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int camera_send_buffers(struct camera *camera)
+{
+	MMAL_BUFFER_HEADER_T *buf;
+	MMAL_STATUS_T ret;
+	int i = 0;
+
+	while ((buf = mmal_queue_get(camera->pool->free_pool->queue))) {
+		ret = mmal_port_send_buffer(camera->port, buf);
+		if (ret != MMAL_SUCCESS) {
+			fprintf(stderr, "Couldn't queue free buffer: %d\n", ret);
+			return -1;
+		}
+		i++;
+	}
+	if (i != camera->port->buffer_num)
+		fprintf(stderr, "Queued an unexpected number of buffers (%d)\n", i);
+
+	return 0;
+}
+
+static int camera_set_config(struct camera *camera)
+{
+	MMAL_STATUS_T ret;
+	MMAL_PARAMETER_CAMERA_CONFIG_T camera_config = {
+		.hdr = { MMAL_PARAMETER_CAMERA_CONFIG, sizeof(camera_config) },
+		.max_stills_w = 0,
+		.max_stills_h = 0,
+		.stills_yuv422 = 0,
+		.one_shot_stills = 1,
+		.max_preview_video_w = camera->max_width,
+		.max_preview_video_h = camera->max_height,
+		.num_preview_video_frames = 3,
+		.stills_capture_circular_buffer_height = 0,
+		.fast_preview_resume = 0,
+		.use_stc_timestamp = MMAL_PARAM_TIMESTAMP_MODE_RESET_STC
+	};
+
+	ret = mmal_port_parameter_set_uint32(camera->component->control,
+			MMAL_PARAMETER_CAMERA_CUSTOM_SENSOR_CONFIG, camera->sensor_mode);
+	if (ret != MMAL_SUCCESS) {
+		fprintf(stderr, "Setting sensor mode %d failed: %d\n", camera->sensor_mode, ret);
+		return -1;
+	}
+
+	ret = mmal_port_parameter_set(camera->component->control, &camera_config.hdr);
+	if (ret != MMAL_SUCCESS) {
+		fprintf(stderr, "Configuring camera parameters failed: %d\n", ret);
+		return -1;
+	}
+
+	return 0;
+}
+
+int camera_reconfigure(struct camera *camera, uint32_t width, uint32_t height,
+		       unsigned int fps, unsigned int sensor_mode)
+{
+	MMAL_BUFFER_HEADER_T *buf;
+	MMAL_STATUS_T ret;
+	bool restart;
+
+	/* The camera config can only change while the component is disabled */
+	restart = width > camera->max_width || height > camera->max_height ||
+		  sensor_mode != camera->sensor_mode;
+
+	ret = mmal_port_disable(camera->port);
+	if (ret != MMAL_SUCCESS) {
+		fprintf(stderr, "Couldn't disable camera port: %d\n", ret);
+		return -1;
+	}
+
+	/* Anything not yet dequeued is stale */
+	while ((buf = mmal_queue_get(camera->pool->ready_queue)))
+		mmal_buffer_header_release(buf);
+
+	if (restart) {
+		ret = mmal_component_disable(camera->component);
+		if (ret != MMAL_SUCCESS) {
+			fprintf(stderr, "Couldn't disable component: %d\n", ret);
+			return -1;
+		}
+
+		camera->max_width = width > camera->max_width ? width : camera->max_width;
+		camera->max_height = height > camera->max_height ? height : camera->max_height;
+		camera->sensor_mode = sensor_mode;
+		if (camera_set_config(camera))
+			return -1;
+
+		/* The STC gets reset when the camera starts again */
+		__atomic_store_n(&camera->stc_offset, INT64_MAX, __ATOMIC_RELAXED);
+	}
+
+	camera->width = width;
+	camera->height = height;
+	camera->fps = fps;
+	if (camera_commit_format(camera))
+		return -1;
+
+	if (restart) {
+		ret = mmal_component_enable(camera->component);
+		if (ret != MMAL_SUCCESS) {
+			fprintf(stderr, "Couldn't enable component: %d\n", ret);
+			return -1;
+		}
+	}
+
+	camera->port->buffer_size = camera->port->buffer_size_recommended;
+	ret = mmal_pool_resize(camera->pool->free_pool, camera->port->buffer_num, camera->port->buffer_size);
+	if (ret != MMAL_SUCCESS) {
+		fprintf(stderr, "Couldn't resize buffer pool: %d\n", ret);
+		return -1;
+	}
+
+	ret = mmal_port_enable(camera->port, camera_frame_callback);
+	if (ret != MMAL_SUCCESS) {
+		fprintf(stderr, "Couldn't enable camera port: %d\n", ret);
+		return -1;
+	}
+
+	return camera_send_buffers(camera);
+}
+
 struct camera *camera_init(uint32_t width, uint32_t height, unsigned int fps)
 {
 	struct camera *camera = calloc(1, sizeof(*camera));
-	RASPICAM_CAMERA_PARAMETERS default_parameters = { 0 };
-	MMAL_BUFFER_HEADER_T *buf;
-	MMAL_ES_FORMAT_T *format;
 	MMAL_STATUS_T ret;
-	MMAL_PORT_T *ports[2];
-	int i, iret;
+	int iret;
 
 	if (!camera)
 		return NULL;
@@ -197,6 +458,11 @@ struct camera *camera_init(uint32_t width, uint32_t height, unsigned int fps)
 	camera->width = width;
 	camera->height = height;
 	camera->fps = fps;
+	camera->max_width = width;
+	camera->max_height = height;
+	camera->stc_offset = INT64_MAX;
+	pthread_mutex_init(&camera->lock, NULL);
+	pthread_cond_init(&camera->cond, NULL);
 
 	ret = mmal_component_create(MMAL_COMPONENT_DEFAULT_CAMERA, &camera->component);
 	if (ret != MMAL_SUCCESS)
@@ -216,67 +482,31 @@ struct camera *camera_init(uint32_t width, uint32_t height, unsigned int fps)
 		goto fail;
 	}
 
-	MMAL_PARAMETER_CAMERA_CONFIG_T camera_config = {
-		.hdr = { MMAL_PARAMETER_CAMERA_CONFIG, sizeof(camera_config) },
-		.max_stills_w = 0,
-		.max_stills_h = 0,
-		.stills_yuv422 = 0,
-		.stills_yuv422 = 0,
-		.one_shot_stills = 1,
-		.max_preview_video_w = width,
-		.max_preview_video_h = height,
-		.num_preview_video_frames = 3,
-		.stills_capture_circular_buffer_height = 0,
-		.fast_preview_resume = 0,
-		.use_stc_timestamp = MMAL_PARAM_TIMESTAMP_MODE_RESET_STC
-	};
+	iret = camera_set_config(camera);
+	if (iret != 0)
+		goto fail;
 
-	ret = mmal_port_parameter_set(camera->component->control, &camera_config.hdr);
-	if (ret != MMAL_SUCCESS) {
-		fprintf(stderr, "Configuring camera parameters failed: %d\n", ret);
+	raspicamcontrol_set_defaults(&camera->applied);
+	iret = raspicamcontrol_set_all_parameters(camera->component, &camera->applied);
+	if (iret != 0) {
+		fprintf(stderr, "Setting raspicam defaults failed: %d\n", iret);
 		goto fail;
 	}
+	camera->requested = camera->applied;
 
-	raspicamcontrol_set_defaults(&default_parameters);
-	iret = raspicamcontrol_set_all_parameters(camera->component, &default_parameters);
+	iret = pthread_create(&camera->control_thread, NULL, camera_control_thread, camera);
 	if (iret != 0) {
-		fprintf(stderr, "Setting raspicam defaults failed: %d\n", iret);
+		fprintf(stderr, "Couldn't create control thread: %d\n", iret);
 		goto fail;
 	}
+	camera->control_running = true;
 
 	camera->port = camera->component->output[MMAL_CAMERA_PREVIEW_PORT];
 	camera->port->userdata = (void *)camera;
 
-	ports[0] = camera->component->output[MMAL_CAMERA_VIDEO_PORT];
-	ports[1] = camera->component->output[MMAL_CAMERA_CAPTURE_PORT];
-
-	format = camera->port->format;
-	format->encoding = MMAL_ENCODING_OPAQUE;
-	format->encoding_variant = MMAL_ENCODING_I420;
-	format->es->video.width = width;
-	format->es->video.height = height;
-	format->es->video.crop.x = 0;
-	format->es->video.crop.y = 0;
-	format->es->video.crop.width = width;
-	format->es->video.crop.height = height;
-	format->es->video.frame_rate.num = fps;
-	format->es->video.frame_rate.den = 1;
-	ret = mmal_port_format_commit(camera->port);
-	if (ret != MMAL_SUCCESS)
-	{
-		fprintf(stderr, "Couldn't set preview port format: %d\n", ret);
+	iret = camera_commit_format(camera);
+	if (iret != 0)
 		goto fail;
-	}
-
-	for (i = 0; i < 2; i++) {
-		mmal_format_full_copy(ports[i]->format, camera->port->format);
-		ret = mmal_port_format_commit(ports[i]);
-		if (ret != MMAL_SUCCESS)
-		{
-			fprintf(stderr, "Couldn't copy format to port %d: %d\n", i, ret);
-			goto fail;
-		}
-	}
 
 	ret = mmal_port_parameter_set_boolean(camera->port, MMAL_PARAMETER_ZERO_COPY, MMAL_TRUE);
 	if (ret != MMAL_SUCCESS)
@@ -305,17 +535,9 @@ struct camera *camera_init(uint32_t width, uint32_t height, unsigned int fps)
 		goto fail;
 	}
 
-	i = 0;
-	while ((buf = mmal_queue_get(camera->pool->free_pool->queue))) {
-		ret = mmal_port_send_buffer(camera->port, buf);
-		if (ret != MMAL_SUCCESS) {
-			fprintf(stderr, "Couldn't queue free buffer: %d\n", ret);
-			goto fail;
-		}
-		i++;
-	}
-	if (i != camera->port->buffer_num)
-		fprintf(stderr, "Queued an unexpected number of buffers (%d)\n", i);
+	iret = camera_send_buffers(camera);
+	if (iret != 0)
+		goto fail;
 
 	return camera;
 
@@ -4,9 +4,13 @@
 #include "interface/mmal/mmal_buffer.h"
 #include "EGL/egl.h"
 
+#include "cameracontrol.h"
+
 struct camera;
 struct camera_buffer {
 	EGLClientBuffer egl_buf;
+	/* Roughly when the frame arrived, in CLOCK_MONOTONIC ns. 0 if unknown */
+	uint64_t timestamp;
 
 	/* Opaque handle - don't touch! */
 	void *hnd;
@@ -17,5 +21,23 @@ struct camera_buffer *camera_dequeue_buffer(struct camera *camera);
 /* Return a buffer once it's finished with */
 void camera_queue_buffer(struct camera *camera, struct camera_buffer *buf);
 
+/*
+ * Request new camera parameters. This doesn't block: only the fields which
+ * changed are sent to the camera, from a separate control thread. If called
+ * again before that happens, only the latest parameters are applied.
+ */
+void camera_set_parameters(struct camera *camera, const RASPICAM_CAMERA_PARAMETERS *params);
+/* Get the most recently requested parameters */
+void camera_get_parameters(struct camera *camera, RASPICAM_CAMERA_PARAMETERS *params);
+
 struct camera *camera_init(uint32_t width, uint32_t height, unsigned int fps);
+/*
+ * Change the capture format without tearing down the camera. Only the
+ * output port is disabled, unless the size grows past anything used before
+ * or the sensor mode (0 for automatic) changes, which restarts the component.
+ * All buffers must have been queued back first; their EGL images are stale
+ * afterwards.
+ */
+int camera_reconfigure(struct camera *camera, uint32_t width, uint32_t height,
+		       unsigned int fps, unsigned int sensor_mode);
 void camera_exit(struct camera *camera);
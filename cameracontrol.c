@@ -175,6 +175,79 @@ int raspicamcontrol_set_all_parameters(MMAL_COMPONENT_T *camera, const RASPICAM_
    return result;
 }
 
+/**
+ * Set only the parameters which differ between two parameter blocks.
+ * Each parameter set is a synchronous round trip to the GPU, so this is
+ * much cheaper than raspicamcontrol_set_all_parameters for small changes.
+ * @param camera Pointer to camera component
+ * @param applied Pointer to the parameters last applied, which is updated
+ *                for each parameter that gets set successfully (so failed
+ *                ones are tried again next time), or NULL to set everything
+ * @param params Pointer to parameter block containing parameters
+ * @return 0 if successful, none-zero if unsuccessful.
+ */
+#define SET_IF_CHANGED(_field, _set) \
+   if (params->_field != applied->_field) { \
+      ret = _set(camera, params->_field); \
+      if (!ret) \
+         applied->_field = params->_field; \
+      result += ret; \
+   }
+
+int raspicamcontrol_set_changed_parameters(MMAL_COMPONENT_T *camera, RASPICAM_CAMERA_PARAMETERS *applied,
+                                           const RASPICAM_CAMERA_PARAMETERS *params)
+{
+   int result = 0, ret;
+
+   if (!applied)
+      return raspicamcontrol_set_all_parameters(camera, params);
+
+   SET_IF_CHANGED(saturation, raspicamcontrol_set_saturation);
+   SET_IF_CHANGED(sharpness, raspicamcontrol_set_sharpness);
+   SET_IF_CHANGED(contrast, raspicamcontrol_set_contrast);
+   SET_IF_CHANGED(brightness, raspicamcontrol_set_brightness);
+   SET_IF_CHANGED(ISO, raspicamcontrol_set_ISO);
+   SET_IF_CHANGED(videoStabilisation, raspicamcontrol_set_video_stabilisation);
+   SET_IF_CHANGED(exposureCompensation, raspicamcontrol_set_exposure_compensation);
+   SET_IF_CHANGED(exposureMode, raspicamcontrol_set_exposure_mode);
+   SET_IF_CHANGED(exposureMeterMode, raspicamcontrol_set_metering_mode);
+   SET_IF_CHANGED(awbMode, raspicamcontrol_set_awb_mode);
+   SET_IF_CHANGED(imageEffect, raspicamcontrol_set_imageFX);
+   if (params->colourEffects.enable != applied->colourEffects.enable ||
+       params->colourEffects.u != applied->colourEffects.u ||
+       params->colourEffects.v != applied->colourEffects.v)
+   {
+      ret = raspicamcontrol_set_colourFX(camera, &params->colourEffects);
+      if (!ret)
+         applied->colourEffects = params->colourEffects;
+      result += ret;
+   }
+   SET_IF_CHANGED(rotation, raspicamcontrol_set_rotation);
+   if (params->hflip != applied->hflip || params->vflip != applied->vflip)
+   {
+      ret = raspicamcontrol_set_flips(camera, params->hflip, params->vflip);
+      if (!ret)
+      {
+         applied->hflip = params->hflip;
+         applied->vflip = params->vflip;
+      }
+      result += ret;
+   }
+   if (params->roi.x != applied->roi.x || params->roi.y != applied->roi.y ||
+       params->roi.w != applied->roi.w || params->roi.h != applied->roi.h)
+   {
+      ret = raspicamcontrol_set_ROI(camera, params->roi);
+      if (!ret)
+         applied->roi = params->roi;
+      result += ret;
+   }
+   SET_IF_CHANGED(shutter_speed, raspicamcontrol_set_shutter_speed);
+
+   return result;
+}
+
+#undef SET_IF_CHANGED
+
 /**
  * Adjust the saturation level for images
  * @param camera Pointer to camera component
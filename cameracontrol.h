@@ -144,6 +144,8 @@ typedef struct
 
 
 int raspicamcontrol_set_all_parameters(MMAL_COMPONENT_T *camera, const RASPICAM_CAMERA_PARAMETERS *params);
+int raspicamcontrol_set_changed_parameters(MMAL_COMPONENT_T *camera, RASPICAM_CAMERA_PARAMETERS *applied,
+                                           const RASPICAM_CAMERA_PARAMETERS *params);
 int raspicamcontrol_get_all_parameters(MMAL_COMPONENT_T *camera, RASPICAM_CAMERA_PARAMETERS *params);
 void raspicamcontrol_set_defaults(RASPICAM_CAMERA_PARAMETERS *params);
 void raspicamcontrol_check_configuration(int min_gpu_mem);
@@ -0,0 +1,42 @@
+#version 100
+#ifdef MEDIUMP
+#define PREC mediump
+#else
+#define PREC highp
+#endif
+precision PREC float;
+varying highp vec2 v_TexCoord;
+uniform sampler2D tex;
+// Size of one source texel in texture coordinates
+uniform highp vec2 texel;
+// Row-major weights, scaled by scale and offset by bias
+uniform mat3 weights;
+uniform float scale;
+uniform float bias;
+
+vec3 fetch(float dx, float dy)
+{
+	vec3 c = texture2D(tex, v_TexCoord + vec2(dx, dy) * texel).rgb;
+#ifdef GREYSCALE
+	c = vec3(dot(c, vec3(0.299, 0.587, 0.114)));
+#endif
+	return c;
+}
+
+void main()
+{
+	vec3 sum = vec3(0.0);
+
+	// weights is uploaded row-major, so weights[row][col]
+	sum += fetch(-1.0, -1.0) * weights[0][0];
+	sum += fetch( 0.0, -1.0) * weights[0][1];
+	sum += fetch( 1.0, -1.0) * weights[0][2];
+	sum += fetch(-1.0,  0.0) * weights[1][0];
+	sum += fetch( 0.0,  0.0) * weights[1][1];
+	sum += fetch( 1.0,  0.0) * weights[1][2];
+	sum += fetch(-1.0,  1.0) * weights[2][0];
+	sum += fetch( 0.0,  1.0) * weights[2][1];
+	sum += fetch( 1.0,  1.0) * weights[2][2];
+
+	gl_FragColor = vec4(clamp(sum * scale + bias, 0.0, 1.0), 1.0);
+}
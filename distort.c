@@ -0,0 +1,83 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#include <math.h>
+
+#include "distort.h"
+
+float K[] = { 0, 0, 0, 1.0 };
+
+static unsigned int width = 640, height = 480;
+
+void distort_set_size(unsigned int w, unsigned int h)
+{
+	width = w;
+	height = h;
+}
+
+void brown(float xcoord, float ycoord, float *xout, float *yout)
+{
+	double asp = (double)(width) / (double)(height);
+	double xoffs = ((double)width - (double)height) / 2.0 / (double)height;
+	//double xdiff = (xcoord * 2) - 1;
+	double xdiff = (((xcoord * asp) - xoffs) * 2) - 1;
+	double ydiff = (ycoord * 2) - 1;
+	double r = sqrt(xdiff*xdiff + ydiff*ydiff);
+	double newr;
+	double xunit;
+	double yunit;
+
+	xunit = xdiff / r;
+	if (isnan(xunit)) {
+		xunit = 0;
+	}
+
+	yunit = ydiff / r;
+	if (isnan(yunit)) {
+		yunit = 0;
+	}
+
+
+	// Same algorithm used by ImageMagick.
+	// Defined by Professor Helmut Dersch:
+	// http://replay.waybackmachine.org/20090613040829/http://www.all-in-one.ee/~dersch/barrel/barrel.html
+	// http://www.imagemagick.org/Usage/distorts/#barrel
+	newr = r * (K[0]*pow(r, 3) + K[1]*pow(r,2) + K[2]*r + K[3]);
+
+	*xout = (((newr*xunit + 1) / 2) + xoffs) / asp;
+	*yout = (newr*yunit + 1) / 2;
+
+	/*
+	*xout = (0.5 + (xdiff / (1 + K[0]*(r*r) + K[1]*(r*r*r*r))));
+	*yout = (0.5 + (ydiff / (1 + K[0]*(r*r) + K[1]*(r*r*r*r))));
+	*/
+
+	/*
+	*xout = xcoord + (xdiff * K[0] * r * r) + (xdiff * K[1] * r * r *r * r);
+	*yout = ycoord + (ydiff * K[0] * r * r) + (ydiff * K[1] * r * r *r * r);
+	*/
+}
+
+void brown_row(unsigned int n, const float *xcoord, float ycoord, float *xout, float *yout)
+{
+	double asp = (double)(width) / (double)(height);
+	double xoffs = ((double)width - (double)height) / 2.0 / (double)height;
+	double ydiff = (ycoord * 2) - 1;
+	double k0 = K[0], k1 = K[1], k2 = K[2], k3 = K[3];
+	unsigned int i;
+
+	/*
+	 * Same maths as brown(), with the per-row terms hoisted and no calls
+	 * other than sqrt() in the loop so the compiler can vectorise it.
+	 * newr / r is the scale factor applied to the offset from the centre,
+	 * which avoids the unit vectors (and their divide-by-zero at r == 0).
+	 */
+	for (i = 0; i < n; i++) {
+		double xdiff = (((xcoord[i] * asp) - xoffs) * 2) - 1;
+		double r = sqrt(xdiff*xdiff + ydiff*ydiff);
+		double scale = ((k0 * r + k1) * r + k2) * r + k3;
+
+		xout[i] = (((scale * xdiff + 1) / 2) + xoffs) / asp;
+		yout[i] = (scale * ydiff + 1) / 2;
+	}
+}
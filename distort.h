@@ -0,0 +1,18 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#ifndef __DISTORT_H__
+#define __DISTORT_H__
+
+/* Barrel distortion coefficients, see brown() */
+extern float K[4];
+
+/* Set the size of the image being undistorted, for its aspect ratio */
+void distort_set_size(unsigned int width, unsigned int height);
+
+/* tex_coord_func which applies K to normalised coordinates */
+void brown(float xcoord, float ycoord, float *xout, float *yout);
+/* tex_coord_row_func equivalent of brown() */
+void brown_row(unsigned int n, const float *xcoord, float ycoord, float *xout, float *yout);
+
+#endif /* __DISTORT_H__ */
@@ -3,23 +3,147 @@
  */
 
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <GLES2/gl2.h>
 #include <GLES/gl.h>
 
 #include "feed.h"
 #include "drawcall.h"
+#include "trace.h"
 
 void draw_elements(struct drawcall *dc)
 {
 	glDrawElements(GL_TRIANGLE_STRIP, dc->n_indices, GL_UNSIGNED_SHORT, 0);
 }
 
+#define MAX_PROGRAMS 64
+
+/* Which drawcall last uploaded its uniforms to each program */
+static struct {
+	GLuint program;
+	struct drawcall *dc;
+} program_users[MAX_PROGRAMS];
+
+static size_t uniform_size(enum uniform_type type)
+{
+	switch (type) {
+	case UNIFORM_1i:
+		return sizeof(GLint);
+	case UNIFORM_1f:
+		return sizeof(GLfloat);
+	case UNIFORM_2f:
+		return sizeof(GLfloat) * 2;
+	case UNIFORM_MAT_F3:
+		return sizeof(GLfloat) * 9;
+	case UNIFORM_MAT_F4:
+		return sizeof(GLfloat) * 16;
+	}
+
+	return 0;
+}
+
+int drawcall_uniform(struct drawcall *dc, const char *name, enum uniform_type type)
+{
+	struct uniform *u;
+
+	if (dc->n_uniforms >= sizeof(dc->uniforms) / sizeof(dc->uniforms[0])) {
+		fprintf(stderr, "Too many uniforms\n");
+		return -1;
+	}
+
+	u = &dc->uniforms[dc->n_uniforms];
+	memset(u, 0, sizeof(*u));
+	u->type = type;
+	u->dirty = true;
+	/* -1 isn't an error, this shader variant might not use it */
+	u->handle = glGetUniformLocation(dc->shader_program, name);
+
+	return dc->n_uniforms++;
+}
+
+void drawcall_set_uniform(struct drawcall *dc, int slot, const void *value)
+{
+	struct uniform *u = &dc->uniforms[slot];
+	size_t size = uniform_size(u->type);
+
+	if (!u->dirty && !memcmp(&u->value, value, size))
+		return;
+
+	memcpy(&u->value, value, size);
+	u->dirty = true;
+}
+
+static void upload_uniform(struct uniform *u)
+{
+	switch (u->type) {
+	case UNIFORM_1i:
+		glUniform1i(u->handle, u->value.i);
+		break;
+	case UNIFORM_1f:
+		glUniform1f(u->handle, u->value.f[0]);
+		break;
+	case UNIFORM_2f:
+		glUniform2fv(u->handle, 1, u->value.f);
+		break;
+	case UNIFORM_MAT_F3:
+		glUniformMatrix3fv(u->handle, 1, GL_FALSE, u->value.f);
+		break;
+	case UNIFORM_MAT_F4:
+		glUniformMatrix4fv(u->handle, 1, GL_FALSE, u->value.f);
+		break;
+	}
+	u->dirty = false;
+}
+
+static void upload_uniforms(struct drawcall *dc)
+{
+	unsigned int i, slot = MAX_PROGRAMS;
+	bool all = true;
+
+	if (!dc->n_uniforms)
+		return;
+
+	for (i = 0; i < MAX_PROGRAMS; i++) {
+		if (program_users[i].program == dc->shader_program) {
+			slot = i;
+			break;
+		} else if (!program_users[i].program && slot == MAX_PROGRAMS) {
+			slot = i;
+		}
+	}
+
+	/* If the table is full, just upload everything every time */
+	if (slot < MAX_PROGRAMS) {
+		all = program_users[slot].dc != dc;
+		program_users[slot].program = dc->shader_program;
+		program_users[slot].dc = dc;
+	}
+
+	for (i = 0; i < dc->n_uniforms; i++) {
+		if ((all || dc->uniforms[i].dirty) && dc->uniforms[i].handle >= 0)
+			upload_uniform(&dc->uniforms[i]);
+	}
+}
+
 void drawcall_draw(struct feed *feed, struct drawcall *dc)
 {
 	int i;
+
+	trace_begin("drawcall_draw");
 	glUseProgram(dc->shader_program);
+	upload_uniforms(dc);
+
+	/* Before swapping, so that a drawcall sampling itself gets the old one */
+	if (dc->hsrc)
+		dc->textures[dc->hidx].handle = dc->hsrc->fbo.texture;
+	if (dc->history.handle) {
+		struct fbo tmp = dc->fbo;
+		dc->fbo = dc->history;
+		dc->history = tmp;
+	}
 
 	dc->textures[dc->yidx] = feed->ytex;
 	dc->textures[dc->uidx] = feed->utex;
@@ -41,7 +165,8 @@ void drawcall_draw(struct feed *feed, struct drawcall *dc)
 	}
 	for (i = 0; i < dc->n_attributes; i++) {
 		struct attr *attr = &dc->attributes[i];
-		glVertexAttribPointer(attr->loc, attr->size, GL_FLOAT, GL_FALSE, attr->stride, attr->ptr);
+		glVertexAttribPointer(attr->loc, attr->size, attr->type ? attr->type : GL_FLOAT,
+				      attr->normalized, attr->stride, attr->ptr);
 		glEnableVertexAttribArray(attr->loc);
 	}
 
@@ -68,4 +193,62 @@ void drawcall_draw(struct feed *feed, struct drawcall *dc)
 	}
 
 	glUseProgram(0);
+	trace_end("drawcall_draw");
+}
+
+int drawcall_enable_history(struct drawcall *dc)
+{
+	if (!dc->fbo.handle) {
+		fprintf(stderr, "Only FBO passes can have history\n");
+		return -1;
+	}
+
+	dc->history.width = dc->fbo.width;
+	dc->history.height = dc->fbo.height;
+
+	return fbo_init(&dc->history);
+}
+
+void drawcall_sample_output(struct drawcall *dc, unsigned int idx, struct drawcall *src)
+{
+	dc->hsrc = src;
+	dc->hidx = idx;
+	dc->textures[idx] = (struct bind){ .bind = GL_TEXTURE_2D, .handle = src->fbo.texture };
+}
+
+int fbo_init(struct fbo *fbo)
+{
+	if (!fbo->handle) {
+		glGenFramebuffers(1, &fbo->handle);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo->handle);
+
+	if (!fbo->texture) {
+		glGenTextures(1, &fbo->texture);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, fbo->texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, fbo->width, fbo->height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fbo->texture, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "Framebuffer not complete\n");
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		return -1;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	return 0;
+}
+
+void fbo_readback(struct fbo *fbo, void *buf)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo->handle);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, fbo->width, fbo->height, GL_RGBA, GL_UNSIGNED_BYTE, buf);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
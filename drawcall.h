@@ -13,6 +13,11 @@
 #include "feed.h"
 
 struct drawcall {
+	/*
+	 * Stable name for reports and reference images (e.g. "camera"),
+	 * which doesn't depend on the order passes are drawn in
+	 */
+	char name[32];
 	GLuint shader_program;
 	unsigned int n_buffers, n_textures, n_uniforms, n_attributes;
 	int yidx, uidx, vidx;
@@ -20,11 +25,21 @@ struct drawcall {
 	/* Massive hack... any -1 special indexes land in scratch */
 	struct bind scratch;
 	struct bind textures[10];
-	struct bind uniforms[10];
+	/* Uploaded by drawcall_draw() when they change, see drawcall_uniform() */
+	struct uniform uniforms[10];
 	struct attr attributes[10];
 	unsigned int n_indices;
 
 	struct fbo fbo;
+	/*
+	 * If history.handle is set, fbo and history are swapped before each
+	 * draw, so fbo always holds the latest output and history the one
+	 * before it. See drawcall_enable_history().
+	 */
+	struct fbo history;
+	/* textures[hidx] is pointed at hsrc's latest output before drawing */
+	struct drawcall *hsrc;
+	int hidx;
 	struct viewport viewport;
 
 	void (*draw)(struct drawcall *);
@@ -34,4 +49,32 @@ void draw_elements(struct drawcall *dc);
 
 void drawcall_draw(struct feed *feed, struct drawcall *dc);
 
+/*
+ * Add a uniform slot for name to dc, returning the slot index or -1.
+ * Slots can be changed at any time with drawcall_set_uniform(), and
+ * drawcall_draw() uploads only what changed since dc last used its
+ * program (everything, if another drawcall has used it since).
+ * Uniforms which never change can just be set once with glUniform*().
+ */
+int drawcall_uniform(struct drawcall *dc, const char *name, enum uniform_type type);
+/* value points to a GLint for UNIFORM_1i, otherwise GLfloats */
+void drawcall_set_uniform(struct drawcall *dc, int slot, const void *value);
+
+/*
+ * Give dc a second FBO to ping-pong with, so that it can read its own
+ * output from the previous draw with drawcall_sample_output(dc, idx, dc).
+ */
+int drawcall_enable_history(struct drawcall *dc);
+/*
+ * Sample src's latest output in dc->textures[idx]. Unlike using
+ * src->fbo.texture directly, this follows src if it ping-pongs. If src
+ * is dc, that's dc's output from its previous draw.
+ */
+void drawcall_sample_output(struct drawcall *dc, unsigned int idx, struct drawcall *src);
+
+/* Create (if needed) and allocate storage for an RGB FBO of fbo->width x fbo->height */
+int fbo_init(struct fbo *fbo);
+/* Read back the FBO as tightly-packed RGBA. buf must hold width * height * 4 bytes */
+void fbo_readback(struct fbo *fbo, void *buf);
+
 #endif /* __DRAWCALL_H__ */
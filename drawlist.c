@@ -0,0 +1,143 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "drawlist.h"
+
+static int drawlist_index(struct drawlist *list, struct drawcall *dc)
+{
+	unsigned int i;
+
+	for (i = 0; i < list->n; i++) {
+		if (list->dcs[i] == dc)
+			return i;
+	}
+
+	return -1;
+}
+
+static bool samples(struct drawcall *dc, GLuint texture)
+{
+	unsigned int i;
+
+	if (!texture)
+		return false;
+
+	for (i = 0; i < dc->n_textures; i++) {
+		if (dc->textures[i].handle == texture)
+			return true;
+	}
+
+	return false;
+}
+
+int drawlist_add(struct drawlist *list, struct drawcall *dc)
+{
+	unsigned int i, n = list->n;
+
+	if (n >= DRAWLIST_MAX) {
+		fprintf(stderr, "Too many drawcalls\n");
+		return -1;
+	}
+
+	list->dcs[n] = dc;
+	list->deps[n] = 0;
+
+	for (i = 0; i < n; i++) {
+		/* Reads an earlier pass's output */
+		if (samples(dc, list->dcs[i]->fbo.texture))
+			list->deps[n] |= 1U << i;
+
+		/* Overwrites something an earlier pass reads */
+		if (samples(list->dcs[i], dc->fbo.texture))
+			list->deps[n] |= 1U << i;
+	}
+
+	list->n++;
+
+	return 0;
+}
+
+int drawlist_depend(struct drawlist *list, struct drawcall *before, struct drawcall *after)
+{
+	int b = drawlist_index(list, before), a = drawlist_index(list, after);
+
+	if (a < 0 || b < 0) {
+		fprintf(stderr, "Drawcall not in list\n");
+		return -1;
+	}
+
+	list->deps[a] |= 1U << b;
+
+	return 0;
+}
+
+/* How many pieces of state change going from prev to dc */
+static unsigned int state_cost(struct drawcall *prev, struct drawcall *dc)
+{
+	unsigned int i, cost = 0;
+
+	/* Leave the screen until the offscreen passes are done */
+	if (!dc->fbo.handle && (!prev || prev->fbo.handle))
+		cost += 2000;
+
+	if (!prev)
+		return cost;
+
+	/* Weighted so that a target switch outweighs everything else */
+	if (prev->fbo.handle != dc->fbo.handle)
+		cost += 1000;
+	if (prev->shader_program != dc->shader_program)
+		cost += 100;
+
+	for (i = 0; i < dc->n_textures; i++) {
+		if (i >= prev->n_textures || prev->textures[i].handle != dc->textures[i].handle)
+			cost++;
+	}
+	for (i = 0; i < dc->n_buffers; i++) {
+		if (i >= prev->n_buffers || prev->buffers[i].handle != dc->buffers[i].handle)
+			cost++;
+	}
+
+	return cost;
+}
+
+int drawlist_sort(struct drawlist *list)
+{
+	uint32_t done = 0;
+	unsigned int i, k, best, cost, best_cost;
+	struct drawcall *prev = NULL;
+
+	/*
+	 * Greedy topological sort: out of the drawcalls whose dependencies
+	 * are all drawn, take the cheapest switch from the previous one.
+	 * Ties go to submission order.
+	 */
+	for (k = 0; k < list->n; k++) {
+		best = list->n;
+		best_cost = ~0U;
+
+		for (i = 0; i < list->n; i++) {
+			if ((done & (1U << i)) || (list->deps[i] & ~done))
+				continue;
+
+			cost = state_cost(prev, list->dcs[i]);
+			if (cost < best_cost) {
+				best = i;
+				best_cost = cost;
+			}
+		}
+
+		if (best == list->n) {
+			fprintf(stderr, "Drawcall dependencies have a cycle\n");
+			return -1;
+		}
+
+		done |= 1U << best;
+		prev = list->order[k] = list->dcs[best];
+	}
+
+	return 0;
+}
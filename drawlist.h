@@ -0,0 +1,49 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#ifndef __DRAWLIST_H__
+#define __DRAWLIST_H__
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "drawcall.h"
+
+/*
+ * A set of drawcalls to issue each frame, ordered to minimise state
+ * changes: grouped by render target (offscreen ones first), then program,
+ * then textures and buffers. Every render target switch costs a tile
+ * load/store on VideoCore, so that's the most important one.
+ *
+ * A drawcall which samples another's FBO texture is always ordered after
+ * it, and one which renders into an FBO is ordered after anything
+ * submitted before it which samples that FBO. Otherwise, drawcalls are
+ * assumed to be independent - in particular, draws to the same target
+ * are assumed not to overlap. Use drawlist_depend() if they do.
+ *
+ * The same goes for drawcalls which ping-pong (drawcall_enable_history()),
+ * as the order is worked out from the handles when they're added: one
+ * added after a ping-pong pass samples its output from this frame, and
+ * one added before it samples its output from the last frame. Ping-pong
+ * passes never overwrite their previous output, so there's no hazard
+ * either way.
+ */
+#define DRAWLIST_MAX 32
+
+struct drawlist {
+	unsigned int n;
+	/* In submission order */
+	struct drawcall *dcs[DRAWLIST_MAX];
+	/* deps[i] has bit j set if dcs[j] must be drawn before dcs[i] */
+	uint32_t deps[DRAWLIST_MAX];
+
+	/* The order to draw in, valid after drawlist_sort() */
+	struct drawcall *order[DRAWLIST_MAX];
+};
+
+int drawlist_add(struct drawlist *list, struct drawcall *dc);
+/* Make sure before is drawn before after. Both must already be added */
+int drawlist_depend(struct drawlist *list, struct drawcall *before, struct drawcall *after);
+/* Work out list->order. Returns -1 if the dependencies have a cycle */
+int drawlist_sort(struct drawlist *list);
+
+#endif /* __DRAWLIST_H__ */
@@ -12,14 +12,51 @@
 #include "pint.h"
 #include "types.h"
 
+struct pacer_clock;
+
+enum feed_layout {
+	/* Separate Y, U and V textures */
+	FEED_LAYOUT_PLANAR = 0,
+	/* Y in ytex, interleaved UV as GL_LUMINANCE_ALPHA in utex */
+	FEED_LAYOUT_PACKED_UV,
+};
+
 struct feed {
+	enum feed_layout layout;
 	struct bind ytex, utex, vtex;
+	/*
+	 * When the dequeued frame arrived, in CLOCK_MONOTONIC ns (or on the
+	 * clock given to set_rate()). 0 if the feed doesn't know.
+	 */
+	uint64_t timestamp;
 
 	void (*terminate)(struct feed *f);
 	int (*dequeue)(struct feed *f);
 	void (*queue)(struct feed *f);
+	/*
+	 * Change the capture size/rate between frames (not while a frame is
+	 * dequeued). NULL if the feed doesn't support it.
+	 */
+	int (*reconfigure)(struct feed *f, unsigned int width, unsigned int height,
+			   unsigned int fps);
+	/*
+	 * For synthetic feeds: make frames arrive fps times a second on clk,
+	 * with dequeue() waiting for them like a camera, instead of returning
+	 * straight away. NULL if the feed doesn't support it.
+	 */
+	int (*set_rate)(struct feed *f, struct pacer_clock *clk, unsigned int fps);
 };
 
+/* Returned by dequeue() when a finite feed has run out of frames */
+#define FEED_END 1
+
 struct feed *feed_init(struct pint *pint);
 
+/*
+ * Feed a sequence of frames from files. Each file is an 8-bit "pgmyuv"
+ * image, as written by ffmpeg: the Y plane on top, with each row of the
+ * bottom third holding a U row followed by a V row.
+ */
+struct feed *feed_files_init(struct pint *pint, char **files, unsigned int nfiles);
+
 #endif /* __FEED_H__ */
@@ -26,14 +26,27 @@ struct feed_camera {
 	EGLImageKHR yimg, uimg, vimg;
 };
 
-static void terminate(struct feed *f)
+static void destroy_images(struct feed_camera *feed)
 {
-	struct feed_camera *feed = (struct feed_camera *)f;
-
 	if(feed->yimg != EGL_NO_IMAGE_KHR){
 		eglDestroyImageKHR(feed->display, feed->yimg);
 		feed->yimg = EGL_NO_IMAGE_KHR;
 	}
+	if(feed->uimg != EGL_NO_IMAGE_KHR){
+		eglDestroyImageKHR(feed->display, feed->uimg);
+		feed->uimg = EGL_NO_IMAGE_KHR;
+	}
+	if(feed->vimg != EGL_NO_IMAGE_KHR){
+		eglDestroyImageKHR(feed->display, feed->vimg);
+		feed->vimg = EGL_NO_IMAGE_KHR;
+	}
+}
+
+static void terminate(struct feed *f)
+{
+	struct feed_camera *feed = (struct feed_camera *)f;
+
+	destroy_images(feed);
 	glDeleteTextures(1, &feed->base.ytex.handle);
 
 	camera_exit(feed->camera);
@@ -50,6 +63,7 @@ static int dequeue(struct feed *f)
 		fprintf(stderr, "Failed to dequeue camera buffer!\n");
 		return -1;
 	}
+	feed->base.timestamp = feed->buf->timestamp;
 	if(feed->yimg != EGL_NO_IMAGE_KHR){
 		eglDestroyImageKHR(feed->display, feed->yimg);
 		feed->yimg = EGL_NO_IMAGE_KHR;
@@ -105,6 +119,25 @@ static void queue(struct feed *f)
 	feed->buf = NULL;
 }
 
+static int reconfigure(struct feed *f, unsigned int width, unsigned int height,
+		       unsigned int fps)
+{
+	struct feed_camera *feed = (struct feed_camera *)f;
+
+	if (feed->buf) {
+		fprintf(stderr, "Can't reconfigure with a frame dequeued\n");
+		return -1;
+	}
+
+	/*
+	 * The images point at the old buffers, but the textures and
+	 * everything using them can stay as they are.
+	 */
+	destroy_images(feed);
+
+	return camera_reconfigure(feed->camera, width, height, fps, 0);
+}
+
 struct feed *feed_init(struct pint *pint)
 {
 	struct feed_camera *feed = calloc(1, sizeof(*feed));
@@ -150,6 +183,7 @@ struct feed *feed_init(struct pint *pint)
 	feed->base.terminate = terminate;
 	feed->base.dequeue = dequeue;
 	feed->base.queue = queue;
+	feed->base.reconfigure = reconfigure;
 
 	return &feed->base;
 }
@@ -0,0 +1,180 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#include <stdio.h>
+
+#include <GLES2/gl2.h>
+
+#include "feed.h"
+#include "texture.h"
+
+#define ALIGN_UP(_size, _base) ((((_size) + ((_base) - 1))) & (~((_base) - 1)))
+#define STREAM_DEPTH 3
+
+struct feed_files {
+	struct feed base;
+
+	char **files;
+	unsigned int nfiles, next;
+	uint32_t width, height;
+
+	struct texture_stream *stream;
+	struct texture_set *set;
+	struct texture uv;
+};
+
+/*
+ * Upload one pgmyuv frame. The Y plane can be used from the loaded image
+ * as-is, U and V get interleaved into the persistent uv buffer.
+ */
+static int upload_frame(struct feed_files *feed, struct texture *frame)
+{
+	unsigned int row, col;
+	unsigned int cw = feed->width / 2, ch = feed->height / 2;
+	unsigned int pitch = ALIGN_UP(frame->width, 4);
+	unsigned int uvpitch = ALIGN_UP(cw * 2, 4);
+	struct texture y = {
+		.width = feed->width,
+		.height = feed->height,
+		.ncmp = 1,
+		.data = frame->data,
+	};
+
+	if (frame->ncmp != 1 || frame->width != feed->width ||
+	    frame->height != feed->height + ch) {
+		fprintf(stderr, "Frame is %dx%d (%d cmp), expected %dx%d pgmyuv\n",
+			frame->width, frame->height, frame->ncmp,
+			feed->width, feed->height + ch);
+		return -1;
+	}
+
+	for (row = 0; row < ch; row++) {
+		const char *u = frame->data + (feed->height + row) * pitch;
+		const char *v = u + cw;
+		char *dst = feed->uv.data + row * uvpitch;
+
+		for (col = 0; col < cw; col++, dst += 2) {
+			dst[0] = u[col];
+			dst[1] = v[col];
+		}
+	}
+
+	feed->set = texture_stream_next(feed->stream);
+	if (texture_stream_upload(feed->stream, feed->set, 0, &y) ||
+	    texture_stream_upload(feed->stream, feed->set, 1, &feed->uv)) {
+		return -1;
+	}
+
+	feed->base.ytex.handle = feed->set->handles[0];
+	feed->base.utex.handle = feed->set->handles[1];
+	feed->base.vtex = feed->base.utex;
+
+	return 0;
+}
+
+static void terminate(struct feed *f)
+{
+	struct feed_files *feed = (struct feed_files *)f;
+
+	texture_stream_destroy(feed->stream);
+	free(feed->uv.data);
+
+	free(feed);
+}
+
+static int dequeue(struct feed *f)
+{
+	struct feed_files *feed = (struct feed_files *)f;
+	struct texture *frame;
+	int ret;
+
+	if (feed->next >= feed->nfiles)
+		return FEED_END;
+
+	frame = texture_load(feed->files[feed->next]);
+	if (!frame) {
+		fprintf(stderr, "Failed to load %s\n", feed->files[feed->next]);
+		return -1;
+	}
+	feed->next++;
+
+	ret = upload_frame(feed, frame);
+	texture_free(frame);
+
+	return ret;
+}
+
+static void queue(struct feed *f)
+{
+	struct feed_files *feed = (struct feed_files *)f;
+
+	texture_stream_release(feed->stream, feed->set);
+}
+
+struct feed *feed_files_init(struct pint *pint, char **files, unsigned int nfiles)
+{
+	struct texture_stream_plane planes[2];
+	struct texture *frame;
+	struct feed_files *feed;
+
+	if (!nfiles) {
+		fprintf(stderr, "No input frames\n");
+		return NULL;
+	}
+
+	/* The first frame decides the size for the whole sequence */
+	frame = texture_load(files[0]);
+	if (!frame) {
+		fprintf(stderr, "Failed to load %s\n", files[0]);
+		return NULL;
+	}
+
+	if (frame->ncmp != 1 || frame->height % 3 || frame->width % 2) {
+		fprintf(stderr, "%s doesn't look like a pgmyuv frame\n", files[0]);
+		texture_free(frame);
+		return NULL;
+	}
+
+	feed = calloc(1, sizeof(*feed));
+	if (!feed) {
+		texture_free(frame);
+		return NULL;
+	}
+
+	feed->files = files;
+	feed->nfiles = nfiles;
+	feed->width = frame->width;
+	feed->height = (frame->height / 3) * 2;
+	texture_free(frame);
+
+	feed->uv.width = feed->width / 2;
+	feed->uv.height = feed->height / 2;
+	feed->uv.ncmp = 2;
+	feed->uv.datalen = ALIGN_UP(feed->uv.width * 2, 4) * feed->uv.height;
+	feed->uv.data = calloc(feed->uv.datalen, 1);
+	if (!feed->uv.data) {
+		free(feed);
+		return NULL;
+	}
+
+	planes[0] = (struct texture_stream_plane){ feed->width, feed->height, 1 };
+	planes[1] = (struct texture_stream_plane){ feed->uv.width, feed->uv.height, 2 };
+	feed->stream = texture_stream_create(pint->get_egl_display(pint), STREAM_DEPTH, 2, planes);
+	if (!feed->stream) {
+		fprintf(stderr, "Failed to create texture stream\n");
+		free(feed->uv.data);
+		free(feed);
+		return NULL;
+	}
+
+	feed->base.layout = FEED_LAYOUT_PACKED_UV;
+	feed->base.ytex.bind = GL_TEXTURE_2D;
+	feed->base.utex.bind = GL_TEXTURE_2D;
+	feed->base.vtex = feed->base.utex;
+
+	feed->base.terminate = terminate;
+	feed->base.dequeue = dequeue;
+	feed->base.queue = queue;
+
+	return &feed->base;
+}
@@ -1,6 +1,7 @@
 /*
  * Copyright Brian Starkey <stark3y@gmail.com> 2017
  */
+#include <stdbool.h>
 #include <stdio.h>
 
 #include <GLES2/gl2.h>
@@ -8,99 +9,148 @@
 #include <GLES/glext.h>
 
 #include "feed.h"
+#include "pacer.h"
 #include "texture.h"
 
-static void terminate(struct feed *feed)
+#define STREAM_DEPTH 3
+
+struct feed_nocamera {
+	struct feed base;
+
+	struct texture_stream *stream;
+	struct texture_set *set;
+
+	/* CPU-side copy of the current frame, Y and interleaved UV */
+	struct texture *y, *uv;
+	bool dirty;
+
+	/* If set_rate() was called, when the next frame arrives */
+	struct pacer_clock *clk;
+	uint64_t period_ns, next;
+};
+
+static void terminate(struct feed *f)
 {
-	glDeleteTextures(1, &feed->ytex.handle);
+	struct feed_nocamera *feed = (struct feed_nocamera *)f;
+
+	texture_stream_destroy(feed->stream);
+	texture_free(feed->y);
+	texture_free(feed->uv);
 
 	free(feed);
 }
 
 static int dequeue(struct feed *f)
 {
-	f = NULL;
+	struct feed_nocamera *feed = (struct feed_nocamera *)f;
+	uint64_t now;
+
+	if (feed->clk) {
+		now = feed->clk->now(feed->clk);
+		if (!feed->next) {
+			feed->next = now;
+		} else if (now > feed->next) {
+			/* Like a camera, we only get the latest frame */
+			feed->next += (now - feed->next) / feed->period_ns * feed->period_ns;
+		} else {
+			feed->clk->sleep_until(feed->clk, feed->next);
+		}
+		feed->base.timestamp = feed->next;
+		feed->next += feed->period_ns;
+	}
+
+	if (feed->dirty) {
+		feed->set = texture_stream_next(feed->stream);
+		if (texture_stream_upload(feed->stream, feed->set, 0, feed->y) ||
+		    texture_stream_upload(feed->stream, feed->set, 1, feed->uv)) {
+			return -1;
+		}
+		feed->dirty = false;
+	}
+
+	feed->base.ytex.handle = feed->set->handles[0];
+	feed->base.utex.handle = feed->set->handles[1];
+	feed->base.vtex = feed->base.utex;
+
 	return 0;
 }
 
 static void queue(struct feed *f)
 {
-	f = NULL;
-	return;
+	struct feed_nocamera *feed = (struct feed_nocamera *)f;
+
+	texture_stream_release(feed->stream, feed->set);
+}
+
+static int set_rate(struct feed *f, struct pacer_clock *clk, unsigned int fps)
+{
+	struct feed_nocamera *feed = (struct feed_nocamera *)f;
+
+	if (!fps) {
+		return -1;
+	}
+
+	feed->clk = clk;
+	feed->period_ns = 1000000000ULL / fps;
+	feed->next = 0;
+
+	return 0;
 }
 
 struct feed *feed_init(struct pint *pint)
 {
-	struct texture *tex;
-	struct feed *feed = calloc(1, sizeof(*feed));
+	struct texture *cb, *cr;
+	struct texture_stream_plane planes[2];
+	struct feed_nocamera *feed = calloc(1, sizeof(*feed));
 	if (!feed)
 		return NULL;
 
-	pint = NULL;
+	/*
+	 * CPU-provided frames use the packed layout: Y on its own, and U/V
+	 * interleaved into one luminance-alpha texture, so there's one
+	 * fewer upload and texture unit per frame.
+	 */
+	feed->base.layout = FEED_LAYOUT_PACKED_UV;
 
-	tex = texture_load("luma.pgm");
-	if (!tex) {
+	feed->y = texture_load("luma.pgm");
+	if (!feed->y) {
 		fprintf(stderr, "Failed to get texture\n");
 		return NULL;
 	}
 
-	feed->ytex.bind = GL_TEXTURE_2D;
-	glGenTextures(1, &feed->ytex.handle);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, feed->ytex.handle);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, tex->width, tex->height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, tex->data);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	free(tex->data);
-	free(tex);
-
-	tex = texture_load("cb.pgm");
-	if (!tex) {
+	cb = texture_load("cb.pgm");
+	cr = texture_load("cr.pgm");
+	if (!cb || !cr) {
 		fprintf(stderr, "Failed to get texture\n");
 		return NULL;
 	}
 
-	feed->utex.bind = GL_TEXTURE_2D;
-	glGenTextures(1, &feed->utex.handle);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, feed->utex.handle);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, tex->width, tex->height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, tex->data);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	free(tex->data);
-	free(tex);
-
-	tex = texture_load("cr.pgm");
-	if (!tex) {
-		fprintf(stderr, "Failed to get texture\n");
+	feed->uv = texture_interleave(cb, cr);
+	texture_free(cb);
+	texture_free(cr);
+	if (!feed->uv) {
+		fprintf(stderr, "Failed to interleave chroma\n");
+		return NULL;
+	}
+
+	planes[0] = (struct texture_stream_plane){ feed->y->width, feed->y->height, 1 };
+	planes[1] = (struct texture_stream_plane){ feed->uv->width, feed->uv->height, 2 };
+	feed->stream = texture_stream_create(pint->get_egl_display(pint), STREAM_DEPTH, 2, planes);
+	if (!feed->stream) {
+		fprintf(stderr, "Failed to create texture stream\n");
 		return NULL;
 	}
+	feed->dirty = true;
+
+	feed->base.ytex.bind = GL_TEXTURE_2D;
+	feed->base.utex.bind = GL_TEXTURE_2D;
+	/* Keep planar shaders happy - they'll just see U in vtex */
+	feed->base.vtex = feed->base.utex;
+
+	feed->base.terminate = terminate;
+	feed->base.dequeue = dequeue;
+	feed->base.queue = queue;
+	feed->base.set_rate = set_rate;
 
-	feed->vtex.bind = GL_TEXTURE_2D;
-	glGenTextures(1, &feed->vtex.handle);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, feed->vtex.handle);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, tex->width, tex->height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, tex->data);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	free(tex->data);
-	free(tex);
-
-	feed->terminate = terminate;
-	feed->dequeue = dequeue;
-	feed->queue = queue;
-
-	return feed;
+	return &feed->base;
 }
@@ -1,22 +1,66 @@
 #version 100
 #extension GL_OES_EGL_image_external : require
+#ifdef MEDIUMP
+#define PREC mediump
+#else
+#define PREC highp
+#endif
+// Texture coordinates stay highp, only the colour maths drops precision
+varying highp vec2 v_TexCoord;
 uniform samplerExternalOES ytex;
+#ifndef LUMA_ONLY
 uniform samplerExternalOES utex;
 uniform samplerExternalOES vtex;
-varying highp vec2 v_TexCoord;
+#endif
+
+#ifdef LUT
+// Must match LUT_SIZE in lut.h, which describes the layout
+#define LUT_SIZE 17.0
+uniform sampler2D lut;
+
+// The texture filtering interpolates Y and U within a V slice, so just
+// blend the two nearest slices
+PREC vec3 lut_lookup(highp vec3 yuv)
+{
+	highp vec3 p = yuv * (LUT_SIZE - 1.0);
+	highp float slice = floor(p.z);
+	highp float next = min(slice + 1.0, LUT_SIZE - 1.0);
+	highp vec2 tc = vec2((p.x + 0.5) / (LUT_SIZE * LUT_SIZE), (p.y + 0.5) / LUT_SIZE);
+
+	PREC vec3 a = texture2D(lut, tc + vec2(slice / LUT_SIZE, 0.0)).rgb;
+	PREC vec3 b = texture2D(lut, tc + vec2(next / LUT_SIZE, 0.0)).rgb;
+
+	return mix(a, b, p.z - slice);
+}
+#endif
+
 void main()
 {
+	PREC float y = texture2D(ytex,v_TexCoord).r;
+#ifdef LUMA_ONLY
+	gl_FragColor = vec4(y, y, y, 1.0);
+#else
 	// yuv2rgb conversion from
 	// http://robotblogging.blogspot.co.uk/2013/10/gpu-accelerated-camera-processing-on.html
-	highp float y = texture2D(ytex,v_TexCoord).r;
-	highp float u = texture2D(utex,v_TexCoord).r;
-	highp float v = texture2D(vtex,v_TexCoord).r;
+	PREC float u = texture2D(utex,v_TexCoord).r;
+	PREC float v = texture2D(vtex,v_TexCoord).r;
 
-	highp vec4 res;
+	PREC vec4 res;
+#ifdef LUT
+	res = vec4(lut_lookup(vec3(y, u, v)), 1.0);
+#else
 	res.r = (y + (1.370705 * (v-0.5)));
 	res.g = (y - (0.698001 * (v-0.5)) - (0.337633 * (u-0.5)));
 	res.b = (y + (1.732446 * (u-0.5)));
 	res.a = 1.0;
+	res = clamp(res,vec4(0),vec4(1));
+#endif
+
+#ifdef GREYSCALE
+	PREC float grey = dot(res.rgb, vec3(0.299, 0.587, 0.114));
+	res.rgb = vec3(grey);
+#endif
 
-	gl_FragColor = clamp(res,vec4(0),vec4(1));
+	gl_FragColor = res;
+#endif
 }
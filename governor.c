@@ -0,0 +1,75 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#include "governor.h"
+
+/* Frames over budget before stepping down */
+#define GOVERNOR_DOWN_FRAMES 4
+/* Frames under GOVERNOR_HEADROOM_PCT of the budget before stepping up */
+#define GOVERNOR_UP_FRAMES   120
+#define GOVERNOR_HEADROOM_PCT 70
+/* ...which is doubled for each failed step up, up to this */
+#define GOVERNOR_MAX_UP_FRAMES (GOVERNOR_UP_FRAMES * 64)
+/* avg moves 1/2^GOVERNOR_AVG_SHIFT of the way to each new frame time */
+#define GOVERNOR_AVG_SHIFT   3
+
+void governor_init(struct governor *gov, uint64_t budget_ns, unsigned int ntiers)
+{
+	unsigned int i;
+
+	*gov = (struct governor){
+		.budget_ns = budget_ns,
+		.ntiers = ntiers < GOVERNOR_MAX_TIERS ? ntiers : GOVERNOR_MAX_TIERS,
+	};
+
+	for (i = 0; i < gov->ntiers; i++)
+		gov->up_frames[i] = GOVERNOR_UP_FRAMES;
+}
+
+static void set_tier(struct governor *gov, unsigned int tier)
+{
+	/* Back down quickly after stepping up means that tier is too expensive */
+	if (tier > gov->tier && gov->stepped_up && gov->frames < GOVERNOR_UP_FRAMES &&
+	    gov->up_frames[gov->tier] < GOVERNOR_MAX_UP_FRAMES)
+		gov->up_frames[gov->tier] *= 2;
+
+	gov->stepped_up = tier < gov->tier;
+	gov->frames = 0;
+	gov->tier = tier;
+	gov->over = gov->under = 0;
+	/* Start again, as the old average is for the old tier */
+	gov->avg_ns = 0;
+}
+
+bool governor_update(struct governor *gov, uint64_t frame_ns)
+{
+	/* A step up which has stuck, so that tier is affordable again */
+	if (++gov->frames == GOVERNOR_UP_FRAMES && gov->stepped_up)
+		gov->up_frames[gov->tier] = GOVERNOR_UP_FRAMES;
+
+	if (!gov->avg_ns) {
+		gov->avg_ns = frame_ns;
+	} else {
+		gov->avg_ns = gov->avg_ns - (gov->avg_ns >> GOVERNOR_AVG_SHIFT) +
+			      (frame_ns >> GOVERNOR_AVG_SHIFT);
+	}
+
+	if (gov->avg_ns > gov->budget_ns) {
+		gov->under = 0;
+		if (++gov->over >= GOVERNOR_DOWN_FRAMES && gov->tier + 1 < gov->ntiers) {
+			set_tier(gov, gov->tier + 1);
+			return true;
+		}
+	} else if (gov->avg_ns * 100 < gov->budget_ns * GOVERNOR_HEADROOM_PCT) {
+		gov->over = 0;
+		if (gov->tier > 0 && ++gov->under >= gov->up_frames[gov->tier - 1]) {
+			set_tier(gov, gov->tier - 1);
+			return true;
+		}
+	} else {
+		/* Somewhere in between is fine where we are */
+		gov->over = gov->under = 0;
+	}
+
+	return false;
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#ifndef __GOVERNOR_H__
+#define __GOVERNOR_H__
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Picks a quality tier to keep frame times inside a budget. Tier 0 is the
+ * best quality, and each tier after it should be cheaper. It steps down a
+ * tier as soon as the (smoothed) frame time has been over budget for a few
+ * frames, but only steps back up after a long run with plenty of headroom,
+ * so that it doesn't flip-flop between two tiers which straddle the budget.
+ * If stepping up to a tier goes straight back over budget, it waits twice
+ * as long before trying that tier again.
+ * What the tiers actually are is up to the caller.
+ */
+#define GOVERNOR_MAX_TIERS 8
+
+struct governor {
+	uint64_t budget_ns;
+	unsigned int ntiers;
+	unsigned int tier;
+
+	/* Exponentially-weighted average, 0 until the first frame */
+	uint64_t avg_ns;
+	/* Consecutive frames over budget, and with headroom */
+	unsigned int over, under;
+	/* Frames of headroom needed to step up into each tier */
+	unsigned int up_frames[GOVERNOR_MAX_TIERS];
+	/* Since the last change, and whether it was a step up */
+	unsigned int frames;
+	bool stepped_up;
+};
+
+void governor_init(struct governor *gov, uint64_t budget_ns, unsigned int ntiers);
+/* Account for one frame. Returns true if gov->tier changed */
+bool governor_update(struct governor *gov, uint64_t frame_ns);
+
+#endif /* __GOVERNOR_H__ */
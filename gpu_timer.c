@@ -0,0 +1,149 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <GLES2/gl2.h>
+#include "EGL/egl.h"
+
+#include "gpu_timer.h"
+#include "stats.h"
+
+#ifndef GL_TIME_ELAPSED_EXT
+#define GL_TIME_ELAPSED_EXT 0x88BF
+#endif
+#ifndef GL_QUERY_RESULT_EXT
+#define GL_QUERY_RESULT_EXT 0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE_EXT
+#define GL_QUERY_RESULT_AVAILABLE_EXT 0x8867
+#endif
+#ifndef GL_GPU_DISJOINT_EXT
+#define GL_GPU_DISJOINT_EXT 0x8FBB
+#endif
+
+/* Frames in flight before a query is reused */
+#define GPU_TIMER_DEPTH 4
+
+struct gpu_timer {
+	unsigned int npasses;
+	unsigned int frame;
+	bool active;
+	/* npasses queries per frame slot */
+	GLuint *queries;
+	bool *pending;
+
+	void (*gen_queries)(GLsizei n, GLuint *ids);
+	void (*delete_queries)(GLsizei n, const GLuint *ids);
+	void (*begin_query)(GLenum target, GLuint id);
+	void (*end_query)(GLenum target);
+	void (*get_query_objectuiv)(GLuint id, GLenum pname, GLuint *params);
+	void (*get_query_objectui64v)(GLuint id, GLenum pname, uint64_t *params);
+};
+
+struct gpu_timer *gpu_timer_create(unsigned int npasses)
+{
+	const char *exts = (const char *)glGetString(GL_EXTENSIONS);
+	struct gpu_timer *timer;
+
+	if (!exts || !strstr(exts, "GL_EXT_disjoint_timer_query")) {
+		fprintf(stderr, "No GL_EXT_disjoint_timer_query, not timing passes\n");
+		return NULL;
+	}
+
+	timer = calloc(1, sizeof(*timer));
+	if (!timer)
+		return NULL;
+
+	timer->gen_queries = (void *)eglGetProcAddress("glGenQueriesEXT");
+	timer->delete_queries = (void *)eglGetProcAddress("glDeleteQueriesEXT");
+	timer->begin_query = (void *)eglGetProcAddress("glBeginQueryEXT");
+	timer->end_query = (void *)eglGetProcAddress("glEndQueryEXT");
+	timer->get_query_objectuiv = (void *)eglGetProcAddress("glGetQueryObjectuivEXT");
+	timer->get_query_objectui64v = (void *)eglGetProcAddress("glGetQueryObjectui64vEXT");
+	if (!timer->gen_queries || !timer->delete_queries || !timer->begin_query ||
+	    !timer->end_query || !timer->get_query_objectuiv || !timer->get_query_objectui64v) {
+		fprintf(stderr, "Couldn't get timer query functions\n");
+		free(timer);
+		return NULL;
+	}
+
+	timer->npasses = npasses;
+	timer->queries = calloc(npasses * GPU_TIMER_DEPTH, sizeof(*timer->queries));
+	timer->pending = calloc(npasses * GPU_TIMER_DEPTH, sizeof(*timer->pending));
+	if (!timer->queries || !timer->pending) {
+		gpu_timer_destroy(timer);
+		return NULL;
+	}
+	timer->gen_queries(npasses * GPU_TIMER_DEPTH, timer->queries);
+
+	return timer;
+}
+
+void gpu_timer_destroy(struct gpu_timer *timer)
+{
+	if (!timer)
+		return;
+
+	if (timer->queries)
+		timer->delete_queries(timer->npasses * GPU_TIMER_DEPTH, timer->queries);
+	free(timer->queries);
+	free(timer->pending);
+	free(timer);
+}
+
+void gpu_timer_begin(struct gpu_timer *timer, unsigned int pass)
+{
+	unsigned int idx = (timer->frame % GPU_TIMER_DEPTH) * timer->npasses + pass;
+
+	/* The first frame is dominated by one-off driver work, skip it */
+	if (!timer->frame || pass >= timer->npasses || timer->pending[idx])
+		return;
+
+	timer->begin_query(GL_TIME_ELAPSED_EXT, timer->queries[idx]);
+	timer->pending[idx] = true;
+	timer->active = true;
+}
+
+void gpu_timer_end(struct gpu_timer *timer)
+{
+	if (!timer->active)
+		return;
+
+	timer->end_query(GL_TIME_ELAPSED_EXT);
+	timer->active = false;
+}
+
+void gpu_timer_frame(struct gpu_timer *timer)
+{
+	GLuint available;
+	uint64_t ns;
+	GLint disjoint = 0;
+	unsigned int i, idx;
+
+	/* Results are garbage if the GPU clock did something odd */
+	glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+
+	timer->frame++;
+
+	/* Collect whatever finished in older frames */
+	for (idx = 0; idx < timer->npasses * GPU_TIMER_DEPTH; idx++) {
+		if (!timer->pending[idx])
+			continue;
+
+		timer->get_query_objectuiv(timer->queries[idx], GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+		if (!available)
+			continue;
+
+		timer->get_query_objectui64v(timer->queries[idx], GL_QUERY_RESULT_EXT, &ns);
+		timer->pending[idx] = false;
+
+		i = idx % timer->npasses;
+		if (!disjoint)
+			stats_record_pass(i, ns);
+	}
+}
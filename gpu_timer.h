@@ -0,0 +1,24 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#ifndef __GPU_TIMER_H__
+#define __GPU_TIMER_H__
+
+/*
+ * Times each drawcall pass on the GPU with GL_EXT_disjoint_timer_query,
+ * and feeds the results into stats_record_pass(). Queries are
+ * collected a few frames later, so nothing waits on the GPU.
+ */
+struct gpu_timer;
+
+/* Returns NULL if the GL doesn't support timer queries */
+struct gpu_timer *gpu_timer_create(unsigned int npasses);
+void gpu_timer_destroy(struct gpu_timer *timer);
+
+/* Bracket each pass. Only one pass can be timed at a time */
+void gpu_timer_begin(struct gpu_timer *timer, unsigned int pass);
+void gpu_timer_end(struct gpu_timer *timer);
+/* Call once per frame, after all the passes */
+void gpu_timer_frame(struct gpu_timer *timer);
+
+#endif /* __GPU_TIMER_H__ */
@@ -0,0 +1,23 @@
+#version 100
+#ifdef MEDIUMP
+#define PREC mediump
+#else
+#define PREC highp
+#endif
+precision PREC float;
+varying highp vec2 v_TexCoord;
+uniform sampler2D tex;
+
+// RGB to HSV, all components 0-1. Branchless version from
+// http://lolengine.net/blog/2013/07/27/rgb-to-hsv-in-glsl
+void main()
+{
+	vec3 c = texture2D(tex, v_TexCoord).rgb;
+	vec4 K = vec4(0.0, -1.0 / 3.0, 2.0 / 3.0, -1.0);
+	vec4 p = mix(vec4(c.bg, K.wz), vec4(c.gb, K.xy), step(c.b, c.g));
+	vec4 q = mix(vec4(p.xyw, c.r), vec4(c.r, p.yzx), step(p.x, c.r));
+	float d = q.x - min(q.w, q.y);
+	float e = 1.0e-4;
+
+	gl_FragColor = vec4(abs(q.z + (q.w - q.y) / (6.0 * d + e)), d / (q.x + e), q.x, 1.0);
+}
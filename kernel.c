@@ -0,0 +1,228 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <GLES2/gl2.h>
+
+#include "kernel.h"
+#include "shader.h"
+
+static const struct {
+	const char *name;
+	const char *fs;
+	unsigned int flags;
+} kernel_ops[N_KERNEL_OPS] = {
+	[KERNEL_CONV3X3]   = { "conv3x3",   "conv3x3_fs.glsl",   0 },
+	[KERNEL_GAUSSIAN]  = { "gaussian",  "conv3x3_fs.glsl",   0 },
+	[KERNEL_SOBEL]     = { "sobel",     "sobel_fs.glsl",     0 },
+	[KERNEL_THRESHOLD] = { "threshold", "threshold_fs.glsl", 0 },
+	[KERNEL_ERODE]     = { "erode",     "morph_fs.glsl",     0 },
+	[KERNEL_DILATE]    = { "dilate",    "morph_fs.glsl",     SHADER_DILATE },
+	[KERNEL_HSV]       = { "hsv",       "hsv_fs.glsl",       0 },
+};
+
+static const struct kernel_params default_params = {
+	.weights = {
+		0, 0, 0,
+		0, 1, 0,
+		0, 0, 0,
+	},
+	.scale = 1.0f,
+	.bias = 0.0f,
+	.threshold = 0.5f,
+};
+
+static const struct kernel_params gaussian_params = {
+	.weights = {
+		1, 2, 1,
+		2, 4, 2,
+		1, 2, 1,
+	},
+	.scale = 1.0f / 16.0f,
+	.bias = 0.0f,
+	.threshold = 0.5f,
+};
+
+enum kernel_slot {
+	KERNEL_SLOT_WEIGHTS = 0,
+	KERNEL_SLOT_SCALE,
+	KERNEL_SLOT_BIAS,
+	KERNEL_SLOT_THRESHOLD,
+};
+
+/* Maps the 0-1 quad onto the whole viewport */
+static const GLfloat quad_mvp[] = {
+	2.0f,  0.0f,  0.0f,  -1.0f,
+	0.0f,  2.0f,  0.0f,  -1.0f,
+	0.0f,  0.0f,  0.0f,  0.0f,
+	0.0f,  0.0f,  0.0f,  1.0f,
+};
+
+static GLuint quad_vertices, quad_indices;
+
+static void kernel_init_quad(void)
+{
+	static const GLfloat quad[] = {
+		0.0f, 0.0f, 0.0f, 0.0f,
+		1.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 1.0f,
+		1.0f, 1.0f, 1.0f, 1.0f,
+	};
+	static const GLshort idx[] = {
+		0, 2, 1, 3,
+	};
+
+	if (quad_vertices)
+		return;
+
+	glGenBuffers(1, &quad_vertices);
+	glBindBuffer(GL_ARRAY_BUFFER, quad_vertices);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glGenBuffers(1, &quad_indices);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quad_indices);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(idx), idx, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+GLint kernel_program(const char *fs_fname, unsigned int flags)
+{
+	char *vs, *fs;
+	GLint ret = -1;
+
+	vs = shader_load("vertex_shader.glsl");
+	fs = shader_load(fs_fname);
+	if (vs && fs) {
+		ret = shader_compile_variant(vs, fs, flags);
+	}
+
+	free(vs);
+	free(fs);
+	return ret;
+}
+
+int kernel_op_from_name(const char *name)
+{
+	int i;
+
+	for (i = 0; i < N_KERNEL_OPS; i++) {
+		if (!strcmp(name, kernel_ops[i].name))
+			return i;
+	}
+
+	return -1;
+}
+
+struct drawcall *kernel_quad_drawcall(GLint program, GLuint texture,
+				      unsigned int width, unsigned int height)
+{
+	struct drawcall *dc = calloc(1, sizeof(*dc));
+	if (!dc) {
+		return NULL;
+	}
+	dc->yidx = dc->uidx = dc->vidx = -1;
+	dc->shader_program = program;
+
+	kernel_init_quad();
+
+	glUseProgram(dc->shader_program);
+
+	dc->n_attributes = 2;
+	dc->attributes[0] = (struct attr){
+		.loc = glGetAttribLocation(dc->shader_program, "position"),
+		.size = 2,
+		.stride = sizeof(GLfloat) * 4,
+		.ptr = (GLvoid *)0,
+	};
+	dc->attributes[1] = (struct attr){
+		.loc = glGetAttribLocation(dc->shader_program, "tc"),
+		.size = 2,
+		.stride = sizeof(GLfloat) * 4,
+		.ptr = (GLvoid *)(sizeof(GLfloat) * 2),
+	};
+
+	glUniformMatrix4fv(glGetUniformLocation(dc->shader_program, "mvp"), 1, GL_FALSE, quad_mvp);
+	glUniform1i(glGetUniformLocation(dc->shader_program, "tex"), 0);
+
+	glUseProgram(0);
+
+	dc->n_buffers = 2;
+	dc->buffers[0] = (struct bind){ .bind = GL_ARRAY_BUFFER, .handle = quad_vertices };
+	dc->buffers[1] = (struct bind){ .bind = GL_ELEMENT_ARRAY_BUFFER, .handle = quad_indices };
+	dc->n_indices = 4;
+
+	dc->n_textures = 1;
+	dc->textures[0] = (struct bind){ .bind = GL_TEXTURE_2D, .handle = texture };
+
+	dc->fbo.width = width;
+	dc->fbo.height = height;
+	if (fbo_init(&dc->fbo)) {
+		free(dc);
+		return NULL;
+	}
+
+	dc->viewport.w = dc->fbo.width;
+	dc->viewport.h = dc->fbo.height;
+	dc->draw = draw_elements;
+
+	return dc;
+}
+
+void kernel_set_params(struct drawcall *dc, const struct kernel_params *params)
+{
+	drawcall_set_uniform(dc, KERNEL_SLOT_WEIGHTS, params->weights);
+	drawcall_set_uniform(dc, KERNEL_SLOT_SCALE, &params->scale);
+	drawcall_set_uniform(dc, KERNEL_SLOT_BIAS, &params->bias);
+	drawcall_set_uniform(dc, KERNEL_SLOT_THRESHOLD, &params->threshold);
+}
+
+struct drawcall *kernel_drawcall(enum kernel_op op, const struct fbo *src,
+				 const struct kernel_params *params, unsigned int flags)
+{
+	struct drawcall *dc;
+	GLint prog;
+
+	if (op >= N_KERNEL_OPS) {
+		fprintf(stderr, "Unknown kernel op %d\n", op);
+		return NULL;
+	}
+
+	if (!params) {
+		params = &default_params;
+	}
+
+	prog = kernel_program(kernel_ops[op].fs, kernel_ops[op].flags | flags);
+	if (prog < 0) {
+		return NULL;
+	}
+
+	dc = kernel_quad_drawcall(prog, src->texture, src->width, src->height);
+	if (!dc) {
+		glDeleteProgram(prog);
+		return NULL;
+	}
+
+	glUseProgram(prog);
+	glUniform2f(glGetUniformLocation(prog, "texel"),
+		    1.0f / src->width, 1.0f / src->height);
+	glUseProgram(0);
+
+	/* Added in the same order as enum kernel_slot */
+	if (drawcall_uniform(dc, "weights", UNIFORM_MAT_F3) < 0 ||
+	    drawcall_uniform(dc, "scale", UNIFORM_1f) < 0 ||
+	    drawcall_uniform(dc, "bias", UNIFORM_1f) < 0 ||
+	    drawcall_uniform(dc, "threshold", UNIFORM_1f) < 0) {
+		glDeleteFramebuffers(1, &dc->fbo.handle);
+		glDeleteTextures(1, &dc->fbo.texture);
+		glDeleteProgram(prog);
+		free(dc);
+		return NULL;
+	}
+	kernel_set_params(dc, op == KERNEL_GAUSSIAN ? &gaussian_params : params);
+
+	return dc;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#ifndef __KERNEL_H__
+#define __KERNEL_H__
+
+#include <GLES2/gl2.h>
+
+#include "drawcall.h"
+#include "types.h"
+
+/*
+ * Image processing passes which run on the output of an FBO pass. Each
+ * one is a drawcall reading src and rendering a full-screen quad into
+ * its own FBO of the same size, so they can be chained.
+ */
+enum kernel_op {
+	KERNEL_CONV3X3 = 0,
+	KERNEL_GAUSSIAN,
+	KERNEL_SOBEL,
+	KERNEL_THRESHOLD,
+	KERNEL_ERODE,
+	KERNEL_DILATE,
+	KERNEL_HSV,
+	N_KERNEL_OPS,
+};
+
+struct kernel_params {
+	/* KERNEL_CONV3X3: row-major weights, result is sum * scale + bias */
+	GLfloat weights[9];
+	GLfloat scale, bias;
+	/* KERNEL_THRESHOLD: luma cut-off, 0-1 */
+	GLfloat threshold;
+};
+
+/* params may be NULL for the defaults. flags are SHADER_* variant flags */
+struct drawcall *kernel_drawcall(enum kernel_op op, const struct fbo *src,
+				 const struct kernel_params *params, unsigned int flags);
+
+/* Update a kernel_drawcall()'s params, from the next time it's drawn */
+void kernel_set_params(struct drawcall *dc, const struct kernel_params *params);
+
+/*
+ * Building blocks for other full-screen passes: compile vertex_shader.glsl
+ * with fs_fname, and make a drawcall rendering a 0-1 quad with texture bound
+ * to "tex" into a new width x height FBO.
+ */
+GLint kernel_program(const char *fs_fname, unsigned int flags);
+struct drawcall *kernel_quad_drawcall(GLint program, GLuint texture,
+				      unsigned int width, unsigned int height);
+
+/* Look up an op by name ("sobel", "threshold", ...). Returns -1 if unknown */
+int kernel_op_from_name(const char *name);
+
+#endif /* __KERNEL_H__ */
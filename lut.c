@@ -0,0 +1,185 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lut.h"
+
+/* r = y + rv * v, g = y + gu * u + gv * v, b = y + bu * u, with u and v centred on 0 */
+static const struct {
+	float rv, gu, gv, bu;
+} matrices[] = {
+	[LUT_BT601] = { 1.370705f, -0.337633f, -0.698001f, 1.732446f },
+	[LUT_BT709] = { 1.5748f,   -0.1873f,   -0.4681f,   1.8556f },
+};
+
+static float clampf(float v)
+{
+	return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+}
+
+static bool key_match(const struct lut_params *params, const float rgb[3])
+{
+	float max = fmaxf(rgb[0], fmaxf(rgb[1], rgb[2]));
+	float min = fminf(rgb[0], fminf(rgb[1], rgb[2]));
+	float delta = max - min, hue, dist;
+
+	if (max < params->key_min_sat || delta < params->key_min_sat * max)
+		return false;
+
+	if (max == rgb[0])
+		hue = (rgb[1] - rgb[2]) / delta;
+	else if (max == rgb[1])
+		hue = 2.0f + (rgb[2] - rgb[0]) / delta;
+	else
+		hue = 4.0f + (rgb[0] - rgb[1]) / delta;
+	hue /= 6.0f;
+	if (hue < 0.0f)
+		hue += 1.0f;
+
+	dist = fabsf(hue - params->key_hue);
+	if (dist > 0.5f)
+		dist = 1.0f - dist;
+
+	return dist <= params->key_width;
+}
+
+static void lut_entry(const struct lut_params *params, float y, float u, float v,
+		      unsigned char *out)
+{
+	float rgb[3];
+	int i;
+
+	if (params->limited_range) {
+		y = (y - 16.0f / 255.0f) * 255.0f / 219.0f;
+		u = (u - 0.5f) * 255.0f / 224.0f + 0.5f;
+		v = (v - 0.5f) * 255.0f / 224.0f + 0.5f;
+	}
+
+	u -= 0.5f;
+	v -= 0.5f;
+	rgb[0] = y + matrices[params->matrix].rv * v;
+	rgb[1] = y + matrices[params->matrix].gu * u + matrices[params->matrix].gv * v;
+	rgb[2] = y + matrices[params->matrix].bu * u;
+
+	for (i = 0; i < 3; i++) {
+		rgb[i] = clampf(clampf(rgb[i]) * params->gains[i]);
+	}
+
+	if (params->key) {
+		rgb[0] = rgb[1] = rgb[2] = key_match(params, rgb) ? 1.0f : 0.0f;
+	}
+
+	for (i = 0; i < 3; i++) {
+		out[i] = rgb[i] * 255.0f + 0.5f;
+	}
+	out[3] = 255;
+}
+
+static unsigned char *lut_build(const struct lut_params *params)
+{
+	const unsigned int width = LUT_SIZE * LUT_SIZE;
+	const float step = 1.0f / (LUT_SIZE - 1);
+	unsigned int yi, ui, vi;
+	unsigned char *data;
+
+	if (params->matrix >= sizeof(matrices) / sizeof(matrices[0])) {
+		fprintf(stderr, "Unknown LUT matrix %d\n", params->matrix);
+		return NULL;
+	}
+
+	data = malloc(width * LUT_SIZE * 4);
+	if (!data) {
+		return NULL;
+	}
+
+	for (ui = 0; ui < LUT_SIZE; ui++) {
+		for (vi = 0; vi < LUT_SIZE; vi++) {
+			for (yi = 0; yi < LUT_SIZE; yi++) {
+				unsigned char *out = &data[(ui * width + vi * LUT_SIZE + yi) * 4];
+				lut_entry(params, yi * step, ui * step, vi * step, out);
+			}
+		}
+	}
+
+	return data;
+}
+
+void lut_default_params(struct lut_params *params)
+{
+	*params = (struct lut_params){
+		.matrix = LUT_BT601,
+		.gains = { 1.0f, 1.0f, 1.0f },
+		.key_width = 1.0f / 12.0f,
+		.key_min_sat = 0.3f,
+	};
+}
+
+GLuint lut_create(const struct lut_params *params)
+{
+	GLuint texture;
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	/* Within a slice the hardware interpolates, the shader does the rest */
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	lut_update(texture, params);
+
+	return texture;
+}
+
+void lut_update(GLuint texture, const struct lut_params *params)
+{
+	unsigned char *data = lut_build(params);
+
+	if (!data) {
+		return;
+	}
+
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, LUT_SIZE * LUT_SIZE, LUT_SIZE, 0,
+		     GL_RGBA, GL_UNSIGNED_BYTE, data);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	free(data);
+}
+
+int lut_parse_params(char *str, struct lut_params *params)
+{
+	char *opt, *save = NULL;
+
+	for (opt = strtok_r(str, ",", &save); opt; opt = strtok_r(NULL, ",", &save)) {
+		if (!strcmp(opt, "601")) {
+			params->matrix = LUT_BT601;
+		} else if (!strcmp(opt, "709")) {
+			params->matrix = LUT_BT709;
+		} else if (!strcmp(opt, "limited")) {
+			params->limited_range = true;
+		} else if (!strncmp(opt, "wb=", 3)) {
+			if (sscanf(opt + 3, "%f:%f:%f", &params->gains[0],
+				   &params->gains[1], &params->gains[2]) != 3)
+				goto bad;
+		} else if (!strncmp(opt, "key=", 4)) {
+			if (sscanf(opt + 4, "%f:%f:%f", &params->key_hue,
+				   &params->key_width, &params->key_min_sat) < 2)
+				goto bad;
+			params->key = true;
+		} else {
+			goto bad;
+		}
+	}
+
+	return 0;
+
+bad:
+	fprintf(stderr, "Bad LUT option '%s'\n", opt);
+	return -1;
+}
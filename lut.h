@@ -0,0 +1,59 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#ifndef __LUT_H__
+#define __LUT_H__
+#include <stdbool.h>
+
+#include <GLES2/gl2.h>
+
+/*
+ * A 3D colour lookup table indexed directly by Y, U and V, used by the
+ * SHADER_LUT variant of the conversion shader in place of its hardcoded
+ * YUV->RGB maths. Anything per-pixel and colour-only can be baked into
+ * it for free: the colour space, white balance, colour keying...
+ *
+ * It's LUT_SIZE^3 RGBA entries packed into a (LUT_SIZE * LUT_SIZE) x
+ * LUT_SIZE texture: one LUT_SIZE x LUT_SIZE slice (Y across, U down) per
+ * V, left to right. The shader interpolates between slices itself.
+ * 17 points means there's one exactly on the neutral chroma value.
+ */
+#define LUT_SIZE 17
+
+enum lut_matrix {
+	/* The coefficients fragment_shader.glsl uses */
+	LUT_BT601 = 0,
+	LUT_BT709,
+};
+
+struct lut_params {
+	enum lut_matrix matrix;
+	/* Y is 16-235 and U/V 16-240, rather than 0-255 */
+	bool limited_range;
+	/* Multiplied into R, G and B after conversion */
+	float gains[3];
+
+	/*
+	 * Colour key: output white where the hue is within key_width of
+	 * key_hue (both 0-1, wrapping) and the saturation and value are at
+	 * least key_min_sat, black everywhere else.
+	 */
+	bool key;
+	float key_hue, key_width, key_min_sat;
+};
+
+/* BT.601, full range, unity gains, no key */
+void lut_default_params(struct lut_params *params);
+
+/* Returns a new texture, or 0 on failure */
+GLuint lut_create(const struct lut_params *params);
+/* Regenerate an existing LUT texture */
+void lut_update(GLuint texture, const struct lut_params *params);
+
+/*
+ * Parse a comma-separated list of: 601, 709, limited, wb=r:g:b,
+ * key=hue:width[:min_sat]. Returns -1 on error.
+ */
+int lut_parse_params(char *str, struct lut_params *params);
+
+#endif /* __LUT_H__ */
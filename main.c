@@ -12,8 +12,11 @@
 #include <string.h>
 #include <signal.h>
 #include <time.h>
+#include <unistd.h>
 
+#ifdef HAVE_NETPBM
 #include <pam.h>
+#endif
 
 #include <GLES2/gl2.h>
 #include <GLES/gl.h>
@@ -24,6 +27,20 @@
 #include "mesh.h"
 #include "feed.h"
 #include "drawcall.h"
+#include "drawlist.h"
+#include "batch.h"
+#include "distort.h"
+#include "sink.h"
+#include "atlas.h"
+#include "kernel.h"
+#include "reduce.h"
+#include "motion.h"
+#include "governor.h"
+#include "pacer.h"
+#include "lut.h"
+#include "stats.h"
+#include "gpu_timer.h"
+#include "trace.h"
 
 #include "EGL/egl.h"
 
@@ -32,11 +49,39 @@
 #define WIDTH 640
 #define HEIGHT 480
 #define MESHPOINTS 32
+#define SINK_SLOTS 4
+/* Enough to ride out the SD card stalling for a while */
+#define RECORD_SLOTS 16
+
+/* The line follower only looks at brightness */
+#define FBO_SHADER_FLAGS (SHADER_LUMA_ONLY | SHADER_MEDIUMP)
 
 volatile bool should_exit = 0;
+static volatile bool should_flush_trace = 0;
 
 struct mesh *mesh;
 
+/*
+ * Atlas mode (-a): a high-res strip near the floor for line following,
+ * plus a coarse full view, rendered together in one draw
+ */
+static const struct roi atlas_rois[] = {
+	{
+		.x = 0.0f, .y = 0.75f, .w = 1.0f, .h = 0.25f,
+		.width = 128, .height = 16,
+		.xpoints = MESHPOINTS, .ypoints = 8,
+	},
+	{
+		.x = 0.0f, .y = 0.0f, .w = 1.0f, .h = 1.0f,
+		.width = 32, .height = 32,
+		.xpoints = MESHPOINTS, .ypoints = MESHPOINTS,
+	},
+};
+
+static void usr1Handler(int dummy) {
+	should_flush_trace = 1;
+}
+
 void intHandler(int dummy) {
 	printf("Caught signal.\n");
 	should_exit = 1;
@@ -53,6 +98,23 @@ static const GLfloat mat[] = {
 	0.0f,  0.0f,  0.0f,  1.0f,
 };
 
+/* Camera drawcalls' mvp uniform slot, so it can change per-frame */
+#define MVP_SLOT 0
+/* How far to pan towards the centroid each frame, with -z and -m centroid */
+#define PAN_GAIN 0.25f
+
+/*
+ * mat, magnified by zoom around cx, cy (0-1, like the on-screen points)
+ */
+static void zoom_mvp(GLfloat *mvp, float zoom, float cx, float cy)
+{
+	memcpy(mvp, mat, sizeof(mat));
+	mvp[0] = 2.0f * zoom;
+	mvp[3] = -2.0f * zoom * cx;
+	mvp[5] = 2.0f * zoom;
+	mvp[7] = -2.0f * zoom * cy;
+}
+
 static const GLfloat mat2[] = {
 	0.3f,  0.0f,  0.0f, -1.0f,
 	0.0f, -0.3f,  0.0f,  1.0f,
@@ -89,53 +151,9 @@ static const GLfloat rgbmat[] = {
 };
 
 
-float K[] = { 0, 0, 0, 1.0 };
-
-void brown(float xcoord, float ycoord, float *xout, float *yout)
-{
-	double asp = (double)(WIDTH) / (double)(HEIGHT);
-	double xoffs = ((double)(WIDTH - HEIGHT) / 2.0f) / (double)HEIGHT;
-	//double xdiff = (xcoord * 2) - 1;
-	double xdiff = (((xcoord * asp) - xoffs) * 2) - 1;
-	double ydiff = (ycoord * 2) - 1;
-	double r = sqrt(xdiff*xdiff + ydiff*ydiff);
-	double newr;
-	double xunit;
-	double yunit;
-
-	xunit = xdiff / r;
-	if (isnan(xunit)) {
-		xunit = 0;
-	}
-
-	yunit = ydiff / r;
-	if (isnan(yunit)) {
-		yunit = 0;
-	}
-
-
-	// Same algorithm used by ImageMagick.
-	// Defined by Professor Helmut Dersch:
-	// http://replay.waybackmachine.org/20090613040829/http://www.all-in-one.ee/~dersch/barrel/barrel.html
-	// http://www.imagemagick.org/Usage/distorts/#barrel
-	newr = r * (K[0]*pow(r, 3) + K[1]*pow(r,2) + K[2]*r + K[3]);
-
-	*xout = (((newr*xunit + 1) / 2) + xoffs) / asp;
-	*yout = (newr*yunit + 1) / 2;
-
-	/*
-	*xout = (0.5 + (xdiff / (1 + K[0]*(r*r) + K[1]*(r*r*r*r))));
-	*yout = (0.5 + (ydiff / (1 + K[0]*(r*r) + K[1]*(r*r*r*r))));
-	*/
-
-	/*
-	*xout = xcoord + (xdiff * K[0] * r * r) + (xdiff * K[1] * r * r *r * r);
-	*yout = ycoord + (ydiff * K[0] * r * r) + (ydiff * K[1] * r * r *r * r);
-	*/
-}
-
-GLint get_shader(const char *vs_fname, const char *fs_fname)
+GLint get_shader(const char *vs_fname, const char *fs_fname, unsigned int flags)
 {
+	GLint ret;
 	char *vertex_shader_source, *fragment_shader_source;
 
 	vertex_shader_source = shader_load(vs_fname);
@@ -152,48 +170,35 @@ GLint get_shader(const char *vs_fname, const char *fs_fname)
 	printf("Fragment shader:\n");
 	printf("%s\n", fragment_shader_source);
 
-	return shader_compile(vertex_shader_source, fragment_shader_source);
-}
-
-struct mesh {
-	GLfloat *mesh;
-	unsigned int nverts;
-	GLuint mhandle;
+	ret = shader_compile_variant(vertex_shader_source, fragment_shader_source, flags);
 
-	GLshort *indices;
-	unsigned int nindices;
-	GLuint ihandle;
-};
+	free(vertex_shader_source);
+	free(fragment_shader_source);
+	return ret;
+}
 
-struct mesh *get_mesh()
+struct mesh *get_mesh(unsigned int points, enum mesh_format format)
 {
 	struct mesh *mesh = calloc(1, sizeof(*mesh));
 	if (!mesh) {
 		return NULL;
 	}
 
-	mesh->mesh = mesh_build(MESHPOINTS, MESHPOINTS, brown, &mesh->nverts);
+	mesh->mesh = mesh_build_parallel(points, points, brown_row, 0, &mesh->nverts);
 	if (!mesh->mesh) {
 		free(mesh);
 		return NULL;
 	}
 
-	glGenBuffers(1, &mesh->mhandle);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh->mhandle);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(mesh->mesh[0]) * mesh->nverts, mesh->mesh, GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	mesh->indices = mesh_build_indices(MESHPOINTS, MESHPOINTS, &mesh->nindices);
+	mesh->indices = mesh_build_indices(points, points, &mesh->nindices);
 	if (!mesh->indices) {
 		free(mesh->mesh);
 		free(mesh);
 		return NULL;
 	}
 
-	glGenBuffers(1, &mesh->ihandle);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ihandle);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(mesh->indices[0]) * mesh->nindices, mesh->indices, GL_STATIC_DRAW);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	mesh->format = format;
+	mesh_upload(mesh);
 
 	return mesh;
 }
@@ -235,7 +240,7 @@ struct drawcall *draw_fbo_drawcall(const GLfloat *mvp, struct fbo *fbo)
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(idx), idx, GL_STATIC_DRAW);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-	ret = get_shader("vertex_shader.glsl", "quad_fs.glsl");
+	ret = get_shader("vertex_shader.glsl", "quad_fs.glsl", 0);
 	check(ret >= 0);
 	dc->shader_program = ret;
 
@@ -283,15 +288,17 @@ struct drawcall *draw_fbo_drawcall(const GLfloat *mvp, struct fbo *fbo)
 	return dc;
 }
 
-struct drawcall *get_camera_drawcall(const GLfloat *mvp, const char *vs_fname, const char *fs_fname, struct fbo *fbo)
+struct drawcall *get_camera_drawcall(const GLfloat *mvp, struct mesh *mesh,
+				     const char *vs_fname, const char *fs_fname,
+				     unsigned int flags, struct fbo *fbo)
 {
-	GLint posLoc, tcLoc, mvpLoc, texLoc;
+	GLint posLoc, tcLoc, texLoc;
 	struct drawcall *dc = calloc(1, sizeof(*dc));
 	int ret;
 
 	dc->yidx = dc->uidx = dc->vidx = -1;
 
-	ret = get_shader(vs_fname, fs_fname);
+	ret = get_shader(vs_fname, fs_fname, flags);
 	check(ret >= 0);
 	dc->shader_program = ret;
 
@@ -299,21 +306,10 @@ struct drawcall *get_camera_drawcall(const GLfloat *mvp, const char *vs_fname, c
 
 	posLoc = glGetAttribLocation(dc->shader_program, "position");
 	tcLoc = glGetAttribLocation(dc->shader_program, "tc");
-	mvpLoc = glGetUniformLocation(dc->shader_program, "mvp");
 
 	dc->n_attributes = 2;
-	dc->attributes[0] = (struct attr){
-		.loc = posLoc,
-		.size = 2,
-		.stride = sizeof(mesh->mesh[0]) * 4,
-		.ptr = (GLvoid *)0,
-	};
-	dc->attributes[1] = (struct attr){
-		.loc = tcLoc,
-		.size = 2,
-		.stride = sizeof(mesh->mesh[0]) * 4,
-		.ptr = (GLvoid *)(sizeof(mesh->mesh[0]) * 2),
-	};
+	dc->attributes[0] = mesh_attr(mesh, posLoc, 0);
+	dc->attributes[1] = mesh_attr(mesh, tcLoc, 2);
 
 	texLoc = glGetUniformLocation(dc->shader_program, "ytex");
 	glUniform1i(texLoc, 0);
@@ -321,18 +317,31 @@ struct drawcall *get_camera_drawcall(const GLfloat *mvp, const char *vs_fname, c
 	glUniform1i(texLoc, 1);
 	texLoc = glGetUniformLocation(dc->shader_program, "vtex");
 	glUniform1i(texLoc, 2);
-	glUniformMatrix4fv(mvpLoc, 1, GL_FALSE, mvp);
+
+	ret = drawcall_uniform(dc, "mvp", UNIFORM_MAT_F4);
+	check(ret == MVP_SLOT);
+	drawcall_set_uniform(dc, MVP_SLOT, mvp);
 
 	dc->n_buffers = 2;
 	dc->buffers[0] = (struct bind){ .bind = GL_ARRAY_BUFFER, .handle = mesh->mhandle };
 	dc->buffers[1] = (struct bind){ .bind = GL_ELEMENT_ARRAY_BUFFER, .handle = mesh->ihandle };
 	dc->n_indices = mesh->nindices;
 
-	dc->n_textures = 3;
-	// TEXTURE0,1,2 is Y,U,V
-	dc->yidx = 0;
-	dc->uidx = 1;
-	dc->vidx = 2;
+	if (flags & SHADER_LUMA_ONLY) {
+		dc->n_textures = 1;
+		dc->yidx = 0;
+	} else if (flags & SHADER_PACKED_UV) {
+		dc->n_textures = 2;
+		// TEXTURE0,1 is Y,UV
+		dc->yidx = 0;
+		dc->uidx = 1;
+	} else {
+		dc->n_textures = 3;
+		// TEXTURE0,1,2 is Y,U,V
+		dc->yidx = 0;
+		dc->uidx = 1;
+		dc->vidx = 2;
+	}
 
 	dc->viewport.x = 0;
 	dc->viewport.y = 0;
@@ -341,29 +350,9 @@ struct drawcall *get_camera_drawcall(const GLfloat *mvp, const char *vs_fname, c
 
 	if (fbo) {
 		dc->fbo = *fbo;
-		fbo = &dc->fbo;
-
-		if (!fbo->handle) {
-			glGenFramebuffers(1, &fbo->handle);
-		}
-		glBindFramebuffer(GL_FRAMEBUFFER, fbo->handle);
-
-		if (!fbo->texture) {
-			glGenTextures(1, &fbo->texture);
-		}
-
-		glBindTexture(GL_TEXTURE_2D, fbo->texture);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, fbo->width, fbo->height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fbo->texture, 0);
-
-		if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-			fprintf(stderr, "Framebuffer not complete\n");
+		if (fbo_init(&dc->fbo)) {
 			return NULL;
 		}
-
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	}
 
 	dc->draw = draw_elements;
@@ -373,25 +362,287 @@ struct drawcall *get_camera_drawcall(const GLfloat *mvp, const char *vs_fname, c
 	return dc;
 }
 
-int main(int argc, char *argv[]) {
-	int i;
+/*
+ * Presentation is decoupled from processing: every frame runs the FBO
+ * passes, but only some of them draw the debug views and swap.
+ */
+struct display {
+	bool no_present;
+	int swap_interval;
+	/* Present every Nth frame */
+	unsigned int divider;
+	/* ...or at most this often. 0 for no limit */
+	long period_ns;
+	/* Present 2^skip_shift times less often than that, see tiers[] */
+	unsigned int skip_shift;
+	struct timespec last;
+};
+
+static bool should_present(struct display *disp, unsigned int frame, struct timespec now)
+{
+	if (disp->no_present)
+		return false;
+
+	if (disp->period_ns)
+		return elapsed_nanos(disp->last, now) >= (disp->period_ns << disp->skip_shift);
+
+	return (frame % (disp->divider << disp->skip_shift)) == 0;
+}
+
+/*
+ * Quality tiers for the governor, best first. Lower mesh density costs
+ * some distortion accuracy, then the debug views get presented less often.
+ */
+static const struct tier {
+	/* Mesh points in each direction */
+	unsigned int meshpoints;
+	unsigned int skip_shift;
+} tiers[] = {
+	{ MESHPOINTS,     0 },
+	{ MESHPOINTS / 2, 0 },
+	{ MESHPOINTS / 4, 0 },
+	{ MESHPOINTS / 4, 1 },
+	{ MESHPOINTS / 4, 2 },
+};
+#define N_TIERS (sizeof(tiers) / sizeof(tiers[0]))
+
+static void use_mesh(struct drawcall *dc, struct mesh *mesh)
+{
+	dc->attributes[0] = mesh_attr(mesh, dc->attributes[0].loc, 0);
+	dc->attributes[1] = mesh_attr(mesh, dc->attributes[1].loc, 2);
+	dc->buffers[0].handle = mesh->mhandle;
+	dc->buffers[1].handle = mesh->ihandle;
+	dc->n_indices = mesh->nindices;
+}
+
+/*
+ * Read fbo back into a buffer from sink. Returns false if the sink had
+ * nowhere to put it.
+ */
+static bool publish(struct sink *sink, struct fbo *fbo, uint64_t timestamp)
+{
 	struct timespec a, b;
-	struct pint *pint = pint_initialise(WIDTH, HEIGHT);
-	check(pint);
+	void *buf = sink->dequeue(sink, fbo->width, fbo->height);
 
-	signal(SIGINT, intHandler);
+	if (!buf)
+		return false;
+
+	trace_begin("readback");
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	fbo_readback(fbo, buf);
+	clock_gettime(CLOCK_MONOTONIC, &b);
+	stats_record(STATS_READBACK, elapsed_nanos(a, b));
+	sink->queue(sink, timestamp);
+	trace_end("readback");
+
+	return true;
+}
+
+static void bind_lut(struct drawcall *dc, GLuint lut)
+{
+	glUseProgram(dc->shader_program);
+	glUniform1i(glGetUniformLocation(dc->shader_program, "lut"), dc->n_textures);
+	glUseProgram(0);
+	dc->textures[dc->n_textures++] = (struct bind){ .bind = GL_TEXTURE_2D, .handle = lut };
+}
 
-	if (argc == 5) {
-		sscanf(argv[1], "%f", &K[0]);
-		sscanf(argv[2], "%f", &K[1]);
-		sscanf(argv[3], "%f", &K[2]);
-		sscanf(argv[4], "%f", &K[3]);
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [options] [K0 K1 K2 K3]\n", name);
+	fprintf(stderr, "  -b input   Batch process frames from a directory or list file\n");
+	fprintf(stderr, "  -o outdir  Write each FBO pass output to outdir (batch mode)\n");
+	fprintf(stderr, "  -R refdir  Compare each FBO pass output with refdir (batch mode)\n");
+	fprintf(stderr, "  -t tol     Per-channel tolerance for -R (default 0)\n");
+	fprintf(stderr, "  -j file    Write a JSON timing/comparison report (batch mode)\n");
+	fprintf(stderr, "  -e         Time each pass, waiting for the GPU after each (batch mode)\n");
+	fprintf(stderr, "  -i n       Swap interval (vblanks per swap, 0 for no vsync)\n");
+	fprintf(stderr, "  -d n       Only present every nth frame\n");
+	fprintf(stderr, "  -r hz      Present at most hz times a second\n");
+	fprintf(stderr, "  -n         Never present, only run the FBO passes\n");
+	fprintf(stderr, "  -s name    Publish the FBO output to shared memory /name\n");
+	fprintf(stderr, "  -a         Render the regions of interest into an atlas\n");
+	fprintf(stderr, "  -k ops     Chain image kernels after the FBO pass, e.g. gaussian,sobel,threshold\n");
+	fprintf(stderr, "  -L opts    Convert to RGB through a LUT: 601, 709, limited, wb=r:g:b, key=hue:width[:sat]\n");
+	fprintf(stderr, "  -m op[:t]  Reduce the output: mean, minmax, centroid, rows or cols (threshold t)\n");
+	fprintf(stderr, "  -M t[:e]   Detect motion (luma change t), only publishing frames with more than e to -s\n");
+	fprintf(stderr, "  -g ms      Lower quality to keep frames (minus dequeue wait) within ms\n");
+	fprintf(stderr, "  -p fps[:ms] Pace to the feed (nominally fps), with a deadline of ms per frame\n");
+	fprintf(stderr, "  -P ms      Use a simulated clock for -p, with each frame taking ms\n");
+	fprintf(stderr, "  -S path    Serve stats as JSON on a Unix socket at path\n");
+	fprintf(stderr, "  -T file    Record a Chrome trace to file, on exit or SIGUSR1\n");
+	fprintf(stderr, "  -V fmt     Mesh vertex format: float, unorm16 or half\n");
+	fprintf(stderr, "  -w file[:full] Record the FBO output (or the full corrected view) to file\n");
+	fprintf(stderr, "  -z zoom    Digital zoom, following the centroid with -m centroid\n");
+}
+
+int main(int argc, char *argv[]) {
+	int i, opt;
+	struct timespec a, b, c, d;
+	const char *batch_input = NULL;
+	struct batch_opts batch_opts = { 0 };
+	char **batch_files = NULL;
+	unsigned int n_batch_files = 0, frame;
+	struct display disp = {
+		.swap_interval = 1,
+		.divider = 1,
+	};
+	const char *shm_name = NULL;
+	struct atlas *atlas = NULL;
+	bool use_atlas = false;
+	char *kernels = NULL;
+	char *reduce_name = NULL;
+	char *motion_opt = NULL;
+	char *lut_opt = NULL;
+	struct lut_params lut_params;
+	GLuint lut = 0;
+	unsigned int fbo_flags = FBO_SHADER_FLAGS;
+	float motion_energy = 0.0f, still = 0.0f;
+	const char *stats_path = NULL;
+	enum mesh_format mesh_format = MESH_FORMAT_FLOAT;
+	struct gpu_timer *gpu_timer;
+	struct reduce *reduce = NULL;
+	struct reduce_value *reduce_vals = NULL;
+	struct motion *motion = NULL;
+	struct governor governor = { 0 };
+	float budget_ms = 0.0f;
+	struct mesh *tier_meshes[N_TIERS] = { 0 };
+	/* The drawcalls using the distortion mesh, which the tiers change */
+	struct drawcall *mesh_dcs[5];
+	unsigned int n_mesh_dcs = 0;
+	uint64_t wait_ns;
+	char *pace_opt = NULL;
+	float sim_work_ms = -1.0f;
+	struct pacer_sim_clock sim_clock;
+	struct pacer_clock *pace_clock = &pacer_clock_monotonic;
+	struct pacer pacer = { 0 };
+	struct sink *sink = NULL;
+	char *record_opt = NULL;
+	struct sink *recorder = NULL;
+	struct drawcall *record_dc = NULL;
+	uint64_t timestamp;
+	struct feed *feed;
+	float rate, zoom = 1.0f;
+	float pan[2] = { 0.5f, 0.5f };
+	GLfloat mvp[16];
+
+	while ((opt = getopt(argc, argv, "b:o:R:t:j:ei:d:r:ns:ak:L:m:M:g:p:P:S:T:V:w:z:h")) != -1) {
+		switch (opt) {
+		case 'b':
+			batch_input = optarg;
+			break;
+		case 'o':
+			batch_opts.outdir = optarg;
+			break;
+		case 'R':
+			batch_opts.refdir = optarg;
+			break;
+		case 't':
+			batch_opts.tolerance = atoi(optarg);
+			break;
+		case 'j':
+			batch_opts.report = optarg;
+			break;
+		case 'e':
+			batch_opts.pass_timing = true;
+			break;
+		case 'i':
+			disp.swap_interval = atoi(optarg);
+			break;
+		case 'd':
+			disp.divider = atoi(optarg);
+			if (disp.divider < 1)
+				disp.divider = 1;
+			break;
+		case 'r':
+			rate = atof(optarg);
+			disp.period_ns = rate > 0 ? 1000000000.0 / rate : 0;
+			break;
+		case 'n':
+			disp.no_present = true;
+			break;
+		case 's':
+			shm_name = optarg;
+			break;
+		case 'a':
+			use_atlas = true;
+			break;
+		case 'k':
+			kernels = optarg;
+			break;
+		case 'L':
+			lut_opt = optarg;
+			break;
+		case 'm':
+			reduce_name = optarg;
+			break;
+		case 'M':
+			motion_opt = optarg;
+			break;
+		case 'g':
+			budget_ms = atof(optarg);
+			break;
+		case 'p':
+			pace_opt = optarg;
+			break;
+		case 'P':
+			sim_work_ms = atof(optarg);
+			break;
+		case 'S':
+			stats_path = optarg;
+			break;
+		case 'V':
+			if (!strcmp(optarg, "unorm16")) {
+				mesh_format = MESH_FORMAT_UNORM16;
+			} else if (!strcmp(optarg, "half")) {
+				mesh_format = MESH_FORMAT_HALF;
+			} else if (strcmp(optarg, "float")) {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'w':
+			record_opt = optarg;
+			break;
+		case 'z':
+			zoom = atof(optarg);
+			if (zoom < 1.0f) {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'T':
+			trace_enable(optarg);
+			trace_thread_name("render");
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind == 4) {
+		sscanf(argv[optind + 0], "%f", &K[0]);
+		sscanf(argv[optind + 1], "%f", &K[1]);
+		sscanf(argv[optind + 2], "%f", &K[2]);
+		sscanf(argv[optind + 3], "%f", &K[3]);
 
 		K[3] = K[3] - (K[0] + K[1] + K[2]);
+	} else if (argc != optind) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
 	}
+
+	struct pint *pint = pint_initialise(WIDTH, HEIGHT);
+	check(pint);
+
+	signal(SIGINT, intHandler);
+	signal(SIGUSR1, usr1Handler);
+	distort_set_size(WIDTH, HEIGHT);
+#ifdef HAVE_NETPBM
 	pm_init(argv[0], 0);
+#endif
 
-	mesh = get_mesh();
+	mesh = get_mesh(MESHPOINTS, mesh_format);
 	check(mesh);
 
 	printf("GL_VERSION  : %s\n", glGetString(GL_VERSION) );
@@ -400,51 +651,397 @@ int main(int argc, char *argv[]) {
 	glClearColor(0.0f, 0.0f, 1.0f, 1.0f);
 	glViewport(0, 0, WIDTH, HEIGHT);
 
-	struct feed *feed = feed_init(pint);
+	if (batch_input) {
+		batch_files = batch_list_inputs(batch_input, &n_batch_files);
+		check(batch_files);
+		feed = feed_files_init(pint, batch_files, n_batch_files);
+	} else {
+		feed = feed_init(pint);
+	}
 	check(feed);
 
 	struct fbo fbo = {
 		.width = 32,
 		.height = 32,
 	};
-	struct drawcall *dcs[5];
-	dcs[0] = get_camera_drawcall(ymat, "vertex_shader.glsl", "y_shader.glsl", NULL);
-	check(dcs[0]);
-	dcs[1] = get_camera_drawcall(umat, "vertex_shader.glsl", "u_shader.glsl", NULL);
-	check(dcs[1]);
-	dcs[2] = get_camera_drawcall(vmat, "vertex_shader.glsl", "v_shader.glsl", NULL);
-	check(dcs[2]);
-	dcs[3] = get_camera_drawcall(mat, "vertex_shader.glsl", FRAGMENT_SHADER, &fbo);
-	check(dcs[3]);
-	dcs[4] = draw_fbo_drawcall(rgbmat, &dcs[3]->fbo);
-	check(dcs[4]);
+	unsigned int feed_flags = feed->layout == FEED_LAYOUT_PACKED_UV ? SHADER_PACKED_UV : 0;
+	/*
+	 * FRAGMENT_SHADER samples the platform's camera textures, but frames
+	 * from files (or the fake camera) are always plain 2D textures
+	 */
+	const char *camera_fs = feed->ytex.bind == GL_TEXTURE_2D ? "fragment_shader.glsl" : FRAGMENT_SHADER;
+	struct drawlist drawlist = { 0 };
+	struct drawcall *fbo_dc, *out_dc;
+
+	if (use_atlas && zoom != 1.0f) {
+		fprintf(stderr, "Can't zoom the atlas\n");
+		return EXIT_FAILURE;
+	}
+
+	if (lut_opt) {
+		lut_default_params(&lut_params);
+		if (lut_parse_params(lut_opt, &lut_params)) {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+		lut = lut_create(&lut_params);
+		check(lut);
+		/* The LUT needs the chroma too */
+		fbo_flags = (fbo_flags & ~SHADER_LUMA_ONLY) | SHADER_LUT;
+	}
+
+	if (use_atlas) {
+		atlas = atlas_build(atlas_rois, sizeof(atlas_rois) / sizeof(atlas_rois[0]), brown, mesh_format);
+		check(atlas);
+		fbo_dc = get_camera_drawcall(mat, &atlas->mesh, "vertex_shader.glsl", camera_fs, fbo_flags | feed_flags, &atlas->fbo);
+	} else {
+		fbo_dc = get_camera_drawcall(mat, mesh, "vertex_shader.glsl", camera_fs, fbo_flags | feed_flags, &fbo);
+		mesh_dcs[n_mesh_dcs++] = fbo_dc;
+	}
+	check(fbo_dc);
+	if (lut) {
+		bind_lut(fbo_dc, lut);
+	}
+	snprintf(fbo_dc->name, sizeof(fbo_dc->name), use_atlas ? "atlas" : "camera");
+	check(!drawlist_add(&drawlist, fbo_dc));
+	if (zoom != 1.0f) {
+		zoom_mvp(mvp, zoom, pan[0], pan[1]);
+		drawcall_set_uniform(fbo_dc, MVP_SLOT, mvp);
+	}
+	out_dc = fbo_dc;
+
+	if (kernels) {
+		char *name, *save = NULL;
+		int op, n = 0;
+
+		for (name = strtok_r(kernels, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+			op = kernel_op_from_name(name);
+			if (op < 0) {
+				fprintf(stderr, "Bad kernel '%s'\n", name);
+				return EXIT_FAILURE;
+			}
+			out_dc = kernel_drawcall(op, &out_dc->fbo, NULL, 0);
+			check(out_dc);
+			snprintf(out_dc->name, sizeof(out_dc->name), "kernel%d_%s", n++, name);
+			check(!drawlist_add(&drawlist, out_dc));
+		}
+	}
+
+	if (reduce_name) {
+		char *thresh = strchr(reduce_name, ':');
+		int op;
+
+		if (thresh) {
+			*thresh++ = '\0';
+		}
+		op = reduce_op_from_name(reduce_name);
+		if (op < 0) {
+			fprintf(stderr, "Bad reduction '%s'\n", reduce_name);
+			return EXIT_FAILURE;
+		}
+
+		reduce = reduce_create(op, &out_dc->fbo, thresh ? atof(thresh) : 0.5f);
+		check(reduce);
+		reduce_vals = calloc(reduce->width * reduce->height, sizeof(*reduce_vals));
+		check(reduce_vals);
+		for (i = 0; i < reduce->npasses; i++) {
+			snprintf(reduce->passes[i]->name, sizeof(reduce->passes[i]->name), "reduce%d", i);
+			check(!drawlist_add(&drawlist, reduce->passes[i]));
+		}
+	}
+
+	if (motion_opt) {
+		char *energy = strchr(motion_opt, ':');
+
+		if (energy) {
+			*energy++ = '\0';
+			still = atof(energy);
+		}
+
+		motion = motion_create(&out_dc->fbo, atof(motion_opt));
+		check(motion);
+		snprintf(motion->background->name, sizeof(motion->background->name), "motion_background");
+		check(!drawlist_add(&drawlist, motion->background));
+		snprintf(motion->mask->name, sizeof(motion->mask->name), "motion_mask");
+		check(!drawlist_add(&drawlist, motion->mask));
+		for (i = 0; i < motion->energy->npasses; i++) {
+			snprintf(motion->energy->passes[i]->name, sizeof(motion->energy->passes[i]->name),
+				 "motion_energy%d", i);
+			check(!drawlist_add(&drawlist, motion->energy->passes[i]));
+		}
+	}
+
+	if (batch_input) {
+		check(!drawlist_sort(&drawlist));
+		i = batch_run(feed, drawlist.order, drawlist.n, &batch_opts);
+
+		feed->terminate(feed);
+		batch_free_inputs(batch_files, n_batch_files);
+		pint->terminate(pint);
+
+		return i ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	if (shm_name) {
+		sink = sink_shm_init(shm_name, SINK_SLOTS, out_dc->fbo.width, out_dc->fbo.height);
+		check(sink);
+	}
+
+	if (record_opt) {
+		char *mode = strchr(record_opt, ':');
+
+		if (mode) {
+			*mode++ = '\0';
+		}
+
+		if (mode && !strcmp(mode, "full")) {
+			/* Distortion corrected, but otherwise unprocessed */
+			struct fbo full = {
+				.width = WIDTH,
+				.height = HEIGHT,
+			};
+
+			record_dc = get_camera_drawcall(mat, mesh, "vertex_shader.glsl", camera_fs,
+							feed_flags | (lut ? SHADER_LUT : 0), &full);
+			check(record_dc);
+			snprintf(record_dc->name, sizeof(record_dc->name), "record");
+			check(!drawlist_add(&drawlist, record_dc));
+			if (lut) {
+				bind_lut(record_dc, lut);
+			}
+			mesh_dcs[n_mesh_dcs++] = record_dc;
+		} else if (mode) {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		} else {
+			record_dc = out_dc;
+		}
+
+		recorder = sink_record_init(record_opt, RECORD_SLOTS, record_dc->fbo.width, record_dc->fbo.height);
+		check(recorder);
+	}
+
+	pint->set_swap_interval(pint, disp.swap_interval);
+	if (!disp.no_present) {
+		struct drawcall *dc;
+
+		dc = get_camera_drawcall(ymat, mesh, "vertex_shader.glsl", "y_shader.glsl", feed_flags, NULL);
+		check(dc && !drawlist_add(&drawlist, dc));
+		mesh_dcs[n_mesh_dcs++] = dc;
+		dc = get_camera_drawcall(umat, mesh, "vertex_shader.glsl", "u_shader.glsl", feed_flags, NULL);
+		check(dc && !drawlist_add(&drawlist, dc));
+		mesh_dcs[n_mesh_dcs++] = dc;
+		dc = get_camera_drawcall(vmat, mesh, "vertex_shader.glsl", "v_shader.glsl", feed_flags, NULL);
+		check(dc && !drawlist_add(&drawlist, dc));
+		mesh_dcs[n_mesh_dcs++] = dc;
+		dc = draw_fbo_drawcall(rgbmat, &out_dc->fbo);
+		check(dc && !drawlist_add(&drawlist, dc));
+	}
+	check(!drawlist_sort(&drawlist));
+
+	if (stats_path) {
+		check(!stats_serve(stats_path));
+	}
+
+	if (pace_opt) {
+		char *deadline = strchr(pace_opt, ':');
+		float fps;
+
+		if (deadline) {
+			*deadline++ = '\0';
+		}
+		fps = atof(pace_opt);
+		check(fps > 0.0f);
+
+		if (sim_work_ms >= 0.0f) {
+			if (!feed->set_rate) {
+				fprintf(stderr, "-P needs a synthetic feed\n");
+				return EXIT_FAILURE;
+			}
+			/* Timestamps of 0 mean "unknown" */
+			pacer_sim_clock_init(&sim_clock, 1000000000ULL);
+			pace_clock = &sim_clock.base;
+		}
+
+		/* Make a synthetic feed behave like a camera */
+		if (feed->set_rate) {
+			check(!feed->set_rate(feed, pace_clock, fps));
+		}
+
+		pacer_init(&pacer, pace_clock, 1000000000.0f / fps,
+			   deadline ? atof(deadline) * 1000000.0f : 1000000000.0f / fps);
+	}
+	gpu_timer = gpu_timer_create(drawlist.n);
+
+	if (budget_ms > 0.0f) {
+		tier_meshes[0] = mesh;
+		for (i = 1; i < N_TIERS; i++) {
+			if (tiers[i].meshpoints == tiers[i - 1].meshpoints) {
+				tier_meshes[i] = tier_meshes[i - 1];
+				continue;
+			}
+			tier_meshes[i] = get_mesh(tiers[i].meshpoints, mesh_format);
+			check(tier_meshes[i]);
+		}
+		governor_init(&governor, budget_ms * 1000000.0f, N_TIERS);
+	}
 
 	clock_gettime(CLOCK_MONOTONIC, &a);
-	while(!pint->should_end(pint)) {
+	disp.last = a;
+	for (frame = 0; !pint->should_end(pint); frame++) {
+		bool present;
+
+		trace_begin("frame");
+		clock_gettime(CLOCK_MONOTONIC, &c);
+		if (pacer.clock) {
+			trace_begin("pace");
+			pacer_wait(&pacer);
+			trace_end("pace");
+		}
+		trace_begin("dequeue");
 		i = feed->dequeue(feed);
+		trace_end("dequeue");
 		if (i != 0) {
 			fprintf(stderr, "Failed dequeueing\n");
 			break;
 		}
+		if (pacer.clock) {
+			stats_count(STATS_SKIPPED, pacer_frame_start(&pacer, feed->timestamp));
+		}
+		clock_gettime(CLOCK_MONOTONIC, &d);
+		wait_ns = elapsed_nanos(c, d);
+		stats_record(STATS_DEQUEUE_WAIT, wait_ns);
+
+		present = should_present(&disp, frame, a);
+		if (present) {
+			glClear(GL_COLOR_BUFFER_BIT);
+		}
+
+		for (i = 0; i < drawlist.n; i++) {
+			struct drawcall *dc = drawlist.order[i];
+
+			/* Frames which aren't presented only run the FBO passes */
+			if (present || dc->fbo.handle) {
+				if (gpu_timer)
+					gpu_timer_begin(gpu_timer, i);
+				drawcall_draw(feed, dc);
+				if (gpu_timer)
+					gpu_timer_end(gpu_timer);
+			}
+		}
+		if (gpu_timer)
+			gpu_timer_frame(gpu_timer);
+
+		if (reduce) {
+			trace_begin("reduce_read");
+			i = reduce_read(reduce, reduce_vals);
+			stats_set_values(reduce_vals[0].v, i * 3);
+			trace_end("reduce_read");
+		}
+
+		if (zoom != 1.0f) {
+			/*
+			 * The centroid is measured in the zoomed view, so nudge
+			 * the view towards it, without leaving the image.
+			 */
+			if (reduce && reduce->op == REDUCE_CENTROID && reduce_vals[0].v[2] > 0.0f) {
+				for (i = 0; i < 2; i++) {
+					pan[i] += (reduce_vals[0].v[i] - 0.5f) * PAN_GAIN / zoom;
+					pan[i] = fminf(fmaxf(pan[i], 0.5f / zoom), 1.0f - 0.5f / zoom);
+				}
+			}
+			zoom_mvp(mvp, zoom, pan[0], pan[1]);
+			drawcall_set_uniform(fbo_dc, MVP_SLOT, mvp);
+		}
+
+		if (motion) {
+			trace_begin("motion_read");
+			motion_energy = motion_read(motion);
+			stats_set(STATS_MOTION, motion_energy);
+			trace_end("motion_read");
+		}
 
-		glClear(GL_COLOR_BUFFER_BIT);
+		timestamp = feed->timestamp ? feed->timestamp :
+			    a.tv_sec * 1000000000ULL + a.tv_nsec;
+		if (sink && motion && motion_energy <= still) {
+			/* Nothing changed, so don't wake up the consumers */
+			stats_count(STATS_STILL, 1);
+		} else if (sink && !publish(sink, &out_dc->fbo, timestamp)) {
+			stats_count(STATS_DROPPED, 1);
+		}
+
+		/*
+		 * The recording gets every frame, still or not. Dropping is
+		 * better than stalling the render loop on I/O, and the gap
+		 * shows up in the file.
+		 */
+		if (recorder && !publish(recorder, &record_dc->fbo, timestamp)) {
+			stats_count(STATS_RECORD_DROPPED, 1);
+		}
 
-		for (i = 0; i < 5; i++) {
-			drawcall_draw(feed, dcs[i]);
+		if (pacer.clock) {
+			if (pace_clock != &pacer_clock_monotonic) {
+				pacer_sim_advance(&sim_clock, sim_work_ms * 1000000.0f);
+			}
+			if (pacer_frame_done(&pacer)) {
+				stats_count(STATS_DEADLINE_MISSES, 1);
+				trace_instant("deadline_miss");
+			}
+			stats_record(STATS_LATENCY, pacer.latency_ns);
 		}
 
-		pint->swap_buffers(pint);
+		if (present) {
+			trace_begin("swap");
+			pint->swap_buffers(pint);
+			trace_end("swap");
+			disp.last = a;
+			stats_count(STATS_PRESENTED, 1);
+		} else {
+			glFlush();
+		}
 
+		trace_begin("queue");
 		feed->queue(feed);
+		trace_end("queue");
 
 		clock_gettime(CLOCK_MONOTONIC, &b);
-		if (a.tv_sec != b.tv_sec) {
-			long time = elapsed_nanos(a, b);
-			printf("%.3f fps\n", 1000000000.0 / (float)time);
+		stats_count(STATS_FRAMES, 1);
+		stats_record(STATS_FRAME_TIME, elapsed_nanos(a, b));
+
+		/* Waiting for the camera isn't something we can speed up */
+		if (governor.ntiers &&
+		    governor_update(&governor, elapsed_nanos(a, b) - wait_ns)) {
+			for (i = 0; i < n_mesh_dcs; i++) {
+				use_mesh(mesh_dcs[i], tier_meshes[governor.tier]);
+			}
+			disp.skip_shift = tiers[governor.tier].skip_shift;
+			stats_count(STATS_TIER_CHANGES, 1);
+			stats_set(STATS_TIER, governor.tier);
+			trace_instant("tier");
 		}
 		a = b;
+		trace_end("frame");
+
+		if (should_flush_trace) {
+			should_flush_trace = 0;
+			trace_flush();
+		}
 	}
 
+	trace_flush();
+
+	stats_stop();
+	gpu_timer_destroy(gpu_timer);
+	if (sink) {
+		sink->terminate(sink);
+	}
+	if (recorder) {
+		recorder->terminate(recorder);
+	}
+	reduce_free(reduce);
+	free(reduce_vals);
+	motion_free(motion);
+	atlas_free(atlas);
 	feed->terminate(feed);
 	pint->terminate(pint);
 
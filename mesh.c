@@ -1,8 +1,12 @@
 /*
  * Copyright Brian Starkey <stark3y@gmail.com> 2017
  */
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "mesh.h"
 
@@ -45,6 +49,121 @@ GLfloat *mesh_build(unsigned int xpoints, unsigned int ypoints, tex_coord_func t
 	return mesh;
 }
 
+#define MESH_MAX_THREADS 8
+
+struct mesh_job {
+	unsigned int xpoints, ypoints;
+	tex_coord_row_func rowfunc;
+	GLfloat *mesh;
+	/* x of every column, the same for all rows */
+	float *xs;
+	unsigned int next_row;
+};
+
+static void *mesh_build_worker(void *arg)
+{
+	struct mesh_job *job = (struct mesh_job *)arg;
+	unsigned int row, col, xpoints = job->xpoints;
+	double ystep = (double)1.0f / (job->ypoints - 1);
+	float *u, *v;
+	GLfloat *cursor;
+
+	u = malloc(sizeof(*u) * xpoints * 2);
+	if (!u) {
+		return (void *)-1;
+	}
+	v = u + xpoints;
+
+	/* Rows are handed out one at a time, so uneven rows balance out */
+	while ((row = __atomic_fetch_add(&job->next_row, 1, __ATOMIC_RELAXED)) < job->ypoints) {
+		GLfloat y = row * ystep;
+
+		if (job->rowfunc) {
+			job->rowfunc(xpoints, job->xs, y, u, v);
+		}
+
+		cursor = job->mesh + row * xpoints * 4;
+		for (col = 0; col < xpoints; col++, cursor += 4) {
+			cursor[0] = job->xs[col];
+			cursor[1] = y;
+			cursor[2] = job->rowfunc ? u[col] : job->xs[col];
+			cursor[3] = job->rowfunc ? v[col] : y;
+		}
+	}
+
+	free(u);
+	return NULL;
+}
+
+GLfloat *mesh_build_parallel(unsigned int xpoints, unsigned int ypoints,
+			     tex_coord_row_func rowfunc, unsigned int nthreads,
+			     unsigned int *nelems)
+{
+	unsigned int i, nmesh = xpoints * ypoints * 4, nstarted = 0;
+	double xstep = (double)1.0f / (xpoints - 1);
+	pthread_t threads[MESH_MAX_THREADS];
+	struct mesh_job job = {
+		.xpoints = xpoints,
+		.ypoints = ypoints,
+		.rowfunc = rowfunc,
+	};
+	void *ret;
+	int failed = 0;
+
+	if (!nthreads) {
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = ncpus > 0 ? ncpus : 1;
+	}
+	if (nthreads > MESH_MAX_THREADS) {
+		nthreads = MESH_MAX_THREADS;
+	}
+	if (nthreads > ypoints) {
+		nthreads = ypoints;
+	}
+
+	job.mesh = malloc(sizeof(*job.mesh) * nmesh);
+	job.xs = malloc(sizeof(*job.xs) * xpoints);
+	if (!job.mesh || !job.xs) {
+		goto fail;
+	}
+
+	for (i = 0; i < xpoints; i++) {
+		job.xs[i] = i * xstep;
+	}
+
+	/* The calling thread does its share too */
+	for (i = 1; i < nthreads; i++) {
+		if (pthread_create(&threads[nstarted], NULL, mesh_build_worker, &job)) {
+			fprintf(stderr, "Couldn't create mesh thread, continuing with %u\n", nstarted + 1);
+			break;
+		}
+		nstarted++;
+	}
+
+	failed = mesh_build_worker(&job) != NULL;
+	for (i = 0; i < nstarted; i++) {
+		pthread_join(threads[i], &ret);
+		failed |= ret != NULL;
+	}
+
+	if (failed) {
+		goto fail;
+	}
+
+	free(job.xs);
+
+	if (nelems) {
+		*nelems = nmesh;
+	}
+
+	return job.mesh;
+
+fail:
+	free(job.xs);
+	free(job.mesh);
+	return NULL;
+}
+
 GLshort *mesh_build_indices(unsigned int xpoints, unsigned int ypoints,  unsigned int *nindices)
 {
 	unsigned int nrows = ypoints - 1;
@@ -60,7 +179,7 @@ GLshort *mesh_build_indices(unsigned int xpoints, unsigned int ypoints,  unsigne
 	}
 
 	for (row = 0; row < nrows; row++, offset += 2) {
-		for (i = 0; i < nrows + 1; i++, offset += 2) {
+		for (i = 0; i < xpoints; i++, offset += 2) {
 			indices[offset] = row * xpoints + i;
 			indices[offset + 1] = row * xpoints + i + xpoints;
 		}
@@ -77,6 +196,135 @@ GLshort *mesh_build_indices(unsigned int xpoints, unsigned int ypoints,  unsigne
 	return indices;
 }
 
+#ifndef GL_HALF_FLOAT_OES
+#define GL_HALF_FLOAT_OES 0x8D61
+#endif
+
+static GLushort float_to_half(float f)
+{
+	uint32_t bits, mant;
+	int exp;
+	GLushort sign;
+
+	memcpy(&bits, &f, sizeof(bits));
+	sign = (bits >> 16) & 0x8000;
+	exp = ((bits >> 23) & 0xff) - 127 + 15;
+	mant = bits & 0x7fffff;
+
+	if (exp >= 31) {
+		/* Too big (or inf/NaN, which we don't expect), saturate */
+		return sign | 0x7bff;
+	} else if (exp <= 0) {
+		/* Denormal or zero */
+		if (exp < -10)
+			return sign;
+		mant |= 0x800000;
+		return sign | ((mant >> (14 - exp)) + ((mant >> (13 - exp)) & 1));
+	}
+
+	/* Round to nearest, carrying into the exponent if needed */
+	return (sign | (exp << 10) | (mant >> 13)) + ((mant >> 12) & 1);
+}
+
+/* Size in the VBO of one (x, y) pair: the position if component is 0, else the texcoord */
+static unsigned int mesh_pair_size(enum mesh_format format, unsigned int component)
+{
+	switch (format) {
+	case MESH_FORMAT_UNORM16:
+		return component ? sizeof(GLfloat) * 2 : sizeof(GLushort) * 2;
+	case MESH_FORMAT_HALF:
+		return sizeof(GLushort) * 2;
+	default:
+		return sizeof(GLfloat) * 2;
+	}
+}
+
+static unsigned int mesh_vertex_size(enum mesh_format format)
+{
+	return mesh_pair_size(format, 0) + mesh_pair_size(format, 2);
+}
+
+struct attr mesh_attr(const struct mesh *mesh, GLuint loc, unsigned int component)
+{
+	struct attr attr = {
+		.loc = loc,
+		.size = 2,
+		.stride = mesh_vertex_size(mesh->format),
+		.ptr = (GLvoid *)(uintptr_t)(component ? mesh_pair_size(mesh->format, 0) : 0),
+	};
+
+	switch (mesh->format) {
+	case MESH_FORMAT_UNORM16:
+		attr.type = component ? GL_FLOAT : GL_UNSIGNED_SHORT;
+		attr.normalized = component ? GL_FALSE : GL_TRUE;
+		break;
+	case MESH_FORMAT_HALF:
+		attr.type = GL_HALF_FLOAT_OES;
+		break;
+	default:
+		attr.type = GL_FLOAT;
+		break;
+	}
+
+	return attr;
+}
+
+void mesh_upload(struct mesh *mesh)
+{
+	const char *exts = (const char *)glGetString(GL_EXTENSIONS);
+	unsigned int vsize, nverts = mesh->nverts / 4;
+	char *packed = NULL;
+	const void *data = mesh->mesh;
+	unsigned int i;
+
+	if (mesh->format == MESH_FORMAT_HALF &&
+	    (!exts || !strstr(exts, "GL_OES_vertex_half_float"))) {
+		fprintf(stderr, "No GL_OES_vertex_half_float, using float vertices\n");
+		mesh->format = MESH_FORMAT_FLOAT;
+	}
+
+	vsize = mesh_vertex_size(mesh->format);
+	if (mesh->format != MESH_FORMAT_FLOAT) {
+		packed = malloc(vsize * nverts);
+		if (!packed) {
+			fprintf(stderr, "Couldn't pack vertices, using float\n");
+			mesh->format = MESH_FORMAT_FLOAT;
+			vsize = mesh_vertex_size(mesh->format);
+		}
+	}
+
+	if (packed) {
+		for (i = 0; i < nverts; i++) {
+			const GLfloat *src = &mesh->mesh[i * 4];
+			GLushort *dst = (GLushort *)(packed + i * vsize);
+
+			if (mesh->format == MESH_FORMAT_UNORM16) {
+				/* Positions are on a 0-1 grid, texcoords stay float */
+				dst[0] = (GLushort)(src[0] * 65535.0f + 0.5f);
+				dst[1] = (GLushort)(src[1] * 65535.0f + 0.5f);
+				memcpy(&dst[2], &src[2], sizeof(GLfloat) * 2);
+			} else {
+				dst[0] = float_to_half(src[0]);
+				dst[1] = float_to_half(src[1]);
+				dst[2] = float_to_half(src[2]);
+				dst[3] = float_to_half(src[3]);
+			}
+		}
+		data = packed;
+	}
+
+	glGenBuffers(1, &mesh->mhandle);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh->mhandle);
+	glBufferData(GL_ARRAY_BUFFER, vsize * nverts, data, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	free(packed);
+
+	glGenBuffers(1, &mesh->ihandle);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ihandle);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(mesh->indices[0]) * mesh->nindices, mesh->indices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
 void mesh_dump(GLfloat *mesh, unsigned int xpoints, unsigned int ypoints)
 {
 	unsigned int row, col;
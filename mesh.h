@@ -6,10 +6,65 @@
 
 #include <GLES2/gl2.h>
 
+#include "types.h"
+
 typedef void (*tex_coord_func)(float inx, float iny, float *outx, float *outy);
+/*
+ * Batched version of tex_coord_func, converting a whole row of n points
+ * at once: (inx[i], iny) -> (outx[i], outy[i]).
+ */
+typedef void (*tex_coord_row_func)(unsigned int n, const float *inx, float iny,
+				   float *outx, float *outy);
+
+/*
+ * How vertices are stored in the VBO. The compact formats shrink it, and
+ * the vertex fetch bandwidth:
+ *  - UNORM16: positions as normalized GL_UNSIGNED_SHORT, good to 1/65535,
+ *    with float texture coordinates (12 bytes a vertex). Positions are
+ *    always 0-1, but distorted texture coordinates can go outside that,
+ *    and clamping them would move the edges of the image.
+ *  - HALF: OES_vertex_half_float for both (8 bytes a vertex), only good
+ *    to ~1/2048 near 1.0
+ */
+enum mesh_format {
+	MESH_FORMAT_FLOAT = 0,
+	MESH_FORMAT_UNORM16,
+	MESH_FORMAT_HALF,
+};
+
+/*
+ * Vertices are (x, y, u, v) floats. nverts counts GLfloats, not
+ * vertices, for historical reasons. format only affects the VBO.
+ */
+struct mesh {
+	GLfloat *mesh;
+	unsigned int nverts;
+	enum mesh_format format;
+	GLuint mhandle;
+
+	GLshort *indices;
+	unsigned int nindices;
+	GLuint ihandle;
+};
+
+/*
+ * Create the GL buffers for mesh and upload the vertices and indices,
+ * converted to mesh->format. Falls back to MESH_FORMAT_FLOAT if the GL
+ * can't do HALF.
+ */
+void mesh_upload(struct mesh *mesh);
+/* Describe the uploaded position (component 0) or texcoord (component 2) */
+struct attr mesh_attr(const struct mesh *mesh, GLuint loc, unsigned int component);
 
 GLfloat *mesh_build(unsigned int xpoints, unsigned int ypoints, tex_coord_func texfunc,
 		    unsigned int *nelems);
+/*
+ * As mesh_build(), but rows are shared out between nthreads threads (0 for
+ * one per CPU), and texture coordinates are computed a row at a time.
+ */
+GLfloat *mesh_build_parallel(unsigned int xpoints, unsigned int ypoints,
+			     tex_coord_row_func rowfunc, unsigned int nthreads,
+			     unsigned int *nelems);
 GLshort *mesh_build_indices(unsigned int xpoints, unsigned int ypoints,  unsigned int *nindices);
 
 void mesh_dump(GLfloat *mesh, unsigned int xpoints, unsigned int ypoints);
@@ -0,0 +1,38 @@
+#version 100
+#ifdef MEDIUMP
+#define PREC mediump
+#else
+#define PREC highp
+#endif
+precision PREC float;
+varying highp vec2 v_TexCoord;
+uniform sampler2D tex;
+uniform highp vec2 texel;
+
+// 3x3 erosion (min), or dilation (max) with DILATE
+#ifdef DILATE
+#define OP max
+#else
+#define OP min
+#endif
+
+vec3 fetch(float dx, float dy)
+{
+	return texture2D(tex, v_TexCoord + vec2(dx, dy) * texel).rgb;
+}
+
+void main()
+{
+	vec3 res = fetch(0.0, 0.0);
+
+	res = OP(res, fetch(-1.0, -1.0));
+	res = OP(res, fetch( 0.0, -1.0));
+	res = OP(res, fetch( 1.0, -1.0));
+	res = OP(res, fetch(-1.0,  0.0));
+	res = OP(res, fetch( 1.0,  0.0));
+	res = OP(res, fetch(-1.0,  1.0));
+	res = OP(res, fetch( 0.0,  1.0));
+	res = OP(res, fetch( 1.0,  1.0));
+
+	gl_FragColor = vec4(res, 1.0);
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <GLES2/gl2.h>
+
+#include "kernel.h"
+#include "motion.h"
+
+/*
+ * How much of each frame goes into the background. The model is only 8
+ * bits, so it settles within about 0.5 / 255 / MOTION_ALPHA of a still
+ * scene - that needs to be well under the threshold.
+ */
+#define MOTION_ALPHA (1.0f / 16.0f)
+
+#define BACKGROUND_SLOT_ALPHA 0
+#define MASK_SLOT_THRESHOLD   0
+
+static void free_pass(struct drawcall *dc)
+{
+	if (!dc)
+		return;
+
+	glDeleteFramebuffers(1, &dc->fbo.handle);
+	glDeleteTextures(1, &dc->fbo.texture);
+	glDeleteFramebuffers(1, &dc->history.handle);
+	glDeleteTextures(1, &dc->history.texture);
+	glDeleteProgram(dc->shader_program);
+	free(dc);
+}
+
+static void background_draw(struct drawcall *dc)
+{
+	const GLfloat alpha = MOTION_ALPHA;
+
+	draw_elements(dc);
+
+	/* The first frame just seeds the model, after that it's an average */
+	drawcall_set_uniform(dc, BACKGROUND_SLOT_ALPHA, &alpha);
+}
+
+/* A kernel_quad_drawcall() reading src at 0 and other's output at 1 */
+static struct drawcall *motion_pass(const char *fs, const struct fbo *src,
+				    struct drawcall *other, const char *other_name)
+{
+	struct drawcall *dc;
+	GLint prog;
+
+	prog = kernel_program(fs, 0);
+	if (prog < 0) {
+		return NULL;
+	}
+
+	dc = kernel_quad_drawcall(prog, src->texture, src->width, src->height);
+	if (!dc) {
+		glDeleteProgram(prog);
+		return NULL;
+	}
+
+	if (!other) {
+		/* Reading itself */
+		if (drawcall_enable_history(dc)) {
+			free_pass(dc);
+			return NULL;
+		}
+		other = dc;
+	}
+
+	dc->n_textures = 2;
+	drawcall_sample_output(dc, 1, other);
+
+	glUseProgram(prog);
+	glUniform1i(glGetUniformLocation(prog, other_name), 1);
+	glUseProgram(0);
+
+	return dc;
+}
+
+struct motion *motion_create(const struct fbo *src, float threshold)
+{
+	const GLfloat alpha = 1.0f;
+	struct motion *motion = calloc(1, sizeof(*motion));
+
+	if (!motion) {
+		return NULL;
+	}
+
+	motion->background = motion_pass("background_fs.glsl", src, NULL, "prev");
+	if (!motion->background) {
+		goto fail;
+	}
+	if (drawcall_uniform(motion->background, "alpha", UNIFORM_1f) != BACKGROUND_SLOT_ALPHA) {
+		goto fail;
+	}
+	drawcall_set_uniform(motion->background, BACKGROUND_SLOT_ALPHA, &alpha);
+	motion->background->draw = background_draw;
+
+	motion->mask = motion_pass("motion_fs.glsl", src, motion->background, "background");
+	if (!motion->mask) {
+		goto fail;
+	}
+	if (drawcall_uniform(motion->mask, "threshold", UNIFORM_1f) != MASK_SLOT_THRESHOLD) {
+		goto fail;
+	}
+	motion_set_threshold(motion, threshold);
+
+	motion->energy = reduce_create(REDUCE_MEAN, &motion->mask->fbo, 0.0f);
+	if (!motion->energy) {
+		goto fail;
+	}
+
+	return motion;
+
+fail:
+	fprintf(stderr, "Failed to create motion detection\n");
+	motion_free(motion);
+	return NULL;
+}
+
+void motion_free(struct motion *motion)
+{
+	if (!motion)
+		return;
+
+	reduce_free(motion->energy);
+	free_pass(motion->mask);
+	free_pass(motion->background);
+	free(motion);
+}
+
+void motion_set_threshold(struct motion *motion, float threshold)
+{
+	drawcall_set_uniform(motion->mask, MASK_SLOT_THRESHOLD, &threshold);
+}
+
+float motion_read(struct motion *motion)
+{
+	struct reduce_value val;
+
+	reduce_read(motion->energy, &val);
+
+	return val.v[0];
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#ifndef __MOTION_H__
+#define __MOTION_H__
+
+#include "drawcall.h"
+#include "reduce.h"
+
+/*
+ * Motion detection at the resolution of src: a running-average background
+ * model, a mask of where src differs from it, and the mean of the mask as
+ * a single "motion energy" value. All of the drawcalls need adding to the
+ * drawlist, in the order they're listed here.
+ */
+struct motion {
+	/* Ping-pongs, blending src into its previous output */
+	struct drawcall *background;
+	/* 1 where src's luma is more than threshold from the background */
+	struct drawcall *mask;
+	struct reduce *energy;
+};
+
+struct motion *motion_create(const struct fbo *src, float threshold);
+void motion_free(struct motion *motion);
+
+void motion_set_threshold(struct motion *motion, float threshold);
+/* Fraction of src (0-1) which moved in the last frame drawn */
+float motion_read(struct motion *motion);
+
+#endif /* __MOTION_H__ */
@@ -0,0 +1,20 @@
+#version 100
+#ifdef MEDIUMP
+#define PREC mediump
+#else
+#define PREC highp
+#endif
+precision PREC float;
+varying highp vec2 v_TexCoord;
+uniform sampler2D tex;
+uniform sampler2D background;
+uniform float threshold;
+
+void main()
+{
+	vec3 c = texture2D(tex, v_TexCoord).rgb;
+	vec3 bg = texture2D(background, v_TexCoord).rgb;
+	float v = step(threshold, abs(dot(c - bg, vec3(0.299, 0.587, 0.114))));
+
+	gl_FragColor = vec4(vec3(v), 1.0);
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#include <errno.h>
+#include <time.h>
+
+#include "pacer.h"
+
+/* Wake up this long before the frame is due, to cover scheduling latency */
+#define PACER_WAKE_MARGIN_NS 1000000
+/* Estimates move 1/2^PACER_AVG_SHIFT of the way to each new sample */
+#define PACER_AVG_SHIFT 3
+
+static uint64_t monotonic_now(struct pacer_clock *clk)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void monotonic_sleep_until(struct pacer_clock *clk, uint64_t ns)
+{
+	struct timespec ts = {
+		.tv_sec = ns / 1000000000ULL,
+		.tv_nsec = ns % 1000000000ULL,
+	};
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+struct pacer_clock pacer_clock_monotonic = {
+	.now = monotonic_now,
+	.sleep_until = monotonic_sleep_until,
+};
+
+static uint64_t sim_now(struct pacer_clock *clk)
+{
+	struct pacer_sim_clock *sim = (struct pacer_sim_clock *)clk;
+
+	return sim->now;
+}
+
+static void sim_sleep_until(struct pacer_clock *clk, uint64_t ns)
+{
+	struct pacer_sim_clock *sim = (struct pacer_sim_clock *)clk;
+
+	if (ns > sim->now)
+		sim->now = ns;
+}
+
+void pacer_sim_clock_init(struct pacer_sim_clock *sim, uint64_t start)
+{
+	sim->base.now = sim_now;
+	sim->base.sleep_until = sim_sleep_until;
+	sim->now = start;
+}
+
+void pacer_sim_advance(struct pacer_sim_clock *sim, uint64_t ns)
+{
+	sim->now += ns;
+}
+
+static uint64_t smooth(uint64_t avg, uint64_t sample)
+{
+	if (!avg)
+		return sample;
+
+	return avg - (avg >> PACER_AVG_SHIFT) + (sample >> PACER_AVG_SHIFT);
+}
+
+static void add_lag(struct pacer *pacer, uint64_t sample)
+{
+	unsigned int i, n;
+
+	pacer->lag_window[pacer->nlag++ % PACER_LAG_WINDOW] = sample;
+	n = pacer->nlag < PACER_LAG_WINDOW ? pacer->nlag : PACER_LAG_WINDOW;
+
+	pacer->lag_ns = pacer->lag_window[0];
+	for (i = 1; i < n; i++) {
+		if (pacer->lag_window[i] < pacer->lag_ns)
+			pacer->lag_ns = pacer->lag_window[i];
+	}
+}
+
+void pacer_init(struct pacer *pacer, struct pacer_clock *clock,
+		uint64_t period_ns, uint64_t deadline_ns)
+{
+	*pacer = (struct pacer){
+		.clock = clock,
+		.deadline_ns = deadline_ns,
+		.period_ns = period_ns,
+	};
+}
+
+void pacer_wait(struct pacer *pacer)
+{
+	uint64_t due;
+
+	if (!pacer->timestamp || !pacer->period_ns)
+		return;
+
+	/*
+	 * Without timestamps, dequeue() won't wait for anything, so this
+	 * is all the pacing there is.
+	 */
+	due = pacer->timestamp + pacer->period_ns + pacer->lag_ns;
+	if (pacer->has_timestamp)
+		due -= PACER_WAKE_MARGIN_NS;
+
+	/* If it's already late, dequeue() will return straight away */
+	if (due <= pacer->clock->now(pacer->clock))
+		return;
+
+	pacer->clock->sleep_until(pacer->clock, due);
+}
+
+unsigned int pacer_frame_start(struct pacer *pacer, uint64_t timestamp)
+{
+	uint64_t now = pacer->clock->now(pacer->clock), delta;
+	unsigned int skipped = 0;
+
+	pacer->has_timestamp = timestamp != 0;
+	if (!pacer->has_timestamp) {
+		pacer->timestamp = now;
+		return 0;
+	}
+
+	if (pacer->timestamp && timestamp > pacer->timestamp) {
+		delta = timestamp - pacer->timestamp;
+
+		/* Gaps of more than half a period more are missed frames */
+		if (pacer->period_ns && delta > pacer->period_ns + pacer->period_ns / 2) {
+			skipped = (delta + pacer->period_ns / 2) / pacer->period_ns - 1;
+		} else {
+			pacer->period_ns = smooth(pacer->period_ns, delta);
+		}
+	}
+
+	if (now > timestamp)
+		add_lag(pacer, now - timestamp);
+
+	pacer->timestamp = timestamp;
+
+	return skipped;
+}
+
+bool pacer_frame_done(struct pacer *pacer)
+{
+	uint64_t now = pacer->clock->now(pacer->clock);
+
+	pacer->latency_ns = now > pacer->timestamp ? now - pacer->timestamp : 0;
+
+	return pacer->deadline_ns && pacer->latency_ns > pacer->deadline_ns;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#ifndef __PACER_H__
+#define __PACER_H__
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Frames over which the lag is the minimum, see struct pacer */
+#define PACER_LAG_WINDOW 16
+
+/*
+ * Where the pacer (and a paced synthetic feed) get the time from, so that
+ * a deterministic clock can be swapped in for testing. Times are in ns.
+ */
+struct pacer_clock {
+	uint64_t (*now)(struct pacer_clock *clk);
+	void (*sleep_until)(struct pacer_clock *clk, uint64_t ns);
+};
+
+/* CLOCK_MONOTONIC, sleeping with clock_nanosleep() */
+extern struct pacer_clock pacer_clock_monotonic;
+
+/*
+ * Simulated time, which only moves forwards when something sleeps on it or
+ * pacer_sim_advance() is called. The real time taken by work is invisible
+ * to it, so charge it with pacer_sim_advance() instead.
+ */
+struct pacer_sim_clock {
+	struct pacer_clock base;
+	uint64_t now;
+};
+
+void pacer_sim_clock_init(struct pacer_sim_clock *sim, uint64_t start);
+void pacer_sim_advance(struct pacer_sim_clock *sim, uint64_t ns);
+
+/*
+ * Paces the main loop to the feed, from the frames' timestamps: it learns
+ * the frame period and how long after its timestamp a frame can be
+ * dequeued, so the loop can sleep until just before the next one arrives
+ * and start on it straight away, instead of spinning or sitting in the
+ * GL. Each frame's latency is measured from its timestamp to its results
+ * being ready, against a deadline.
+ */
+struct pacer {
+	struct pacer_clock *clock;
+	uint64_t deadline_ns;
+
+	/* Smoothed estimate, 0 until known */
+	uint64_t period_ns;
+
+	/*
+	 * Minimum of the last PACER_LAG_WINDOW lag samples, 0 until known.
+	 * Frames dequeued late (e.g. after a slow frame) give big samples
+	 * which say nothing about when frames arrive, so they mustn't pull
+	 * the estimate up, or we'd sleep past the arrivals from then on.
+	 */
+	uint64_t lag_ns;
+	uint64_t lag_window[PACER_LAG_WINDOW];
+	unsigned int nlag;
+
+	/* The current frame, and whether the feed gave its timestamp */
+	bool has_timestamp;
+	uint64_t timestamp;
+	uint64_t latency_ns;
+};
+
+/* period_ns is the nominal frame period, or 0 to learn it from the feed */
+void pacer_init(struct pacer *pacer, struct pacer_clock *clock,
+		uint64_t period_ns, uint64_t deadline_ns);
+
+/* Sleep until the next frame is nearly due. Call before dequeueing it */
+void pacer_wait(struct pacer *pacer);
+
+/*
+ * A frame with timestamp was just dequeued. If the feed has no timestamps
+ * (0), it's treated as arriving now, and the loop is paced to the nominal
+ * period. Returns how many frames the feed captured since the last one,
+ * which we never saw.
+ */
+unsigned int pacer_frame_start(struct pacer *pacer, uint64_t timestamp);
+
+/* The frame's results are ready. Returns true if it missed the deadline */
+bool pacer_frame_done(struct pacer *pacer);
+
+#endif /* __PACER_H__ */
@@ -12,6 +12,8 @@ struct pint {
 	bool (*should_end)(struct pint *);
 	void (*terminate)(struct pint *);
 	EGLDisplay (*get_egl_display)(struct pint *);
+	/* Number of vblanks per swap, 0 to not wait for vsync at all */
+	void (*set_swap_interval)(struct pint *, int interval);
 };
 
 extern struct pint *pint_initialise(uint32_t width, uint32_t height);
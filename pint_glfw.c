@@ -46,6 +46,12 @@ static EGLDisplay get_egl_display(struct pint *p)
 	return EGL_NO_DISPLAY;
 }
 
+static void set_swap_interval(struct pint *p, int interval)
+{
+	p = NULL;
+	glfwSwapInterval(interval);
+}
+
 struct pint *pint_initialise(uint32_t width, uint32_t height)
 {
 	struct glfw_pint *pint = malloc(sizeof(*pint));
@@ -56,6 +62,7 @@ struct pint *pint_initialise(uint32_t width, uint32_t height)
 	pint->base.terminate = terminate;
 	pint->base.should_end = should_end;
 	pint->base.get_egl_display = get_egl_display;
+	pint->base.set_swap_interval = set_swap_interval;
 
 	glfwInit();
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_ES_API);
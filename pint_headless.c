@@ -0,0 +1,142 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ *
+ * Offscreen pint for bots without a display (and for CI, where Mesa's
+ * llvmpipe works fine). Renders into an EGL pbuffer, and never presents.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <GLES2/gl2.h>
+#include "EGL/egl.h"
+#include "EGL/eglext.h"
+
+#include "pint.h"
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+extern volatile bool should_exit;
+
+#define HEADLESS_PINT(_pint) ((struct headless_pint *)_pint)
+struct headless_pint {
+	struct pint base;
+
+	EGLDisplay display;
+	EGLSurface surface;
+	EGLContext context;
+};
+
+static void swap_buffers(struct pint *p)
+{
+	p = NULL;
+}
+
+static bool should_end(struct pint *p)
+{
+	return should_exit;
+}
+
+static void terminate(struct pint *p)
+{
+	struct headless_pint *pint = HEADLESS_PINT(p);
+
+	eglMakeCurrent(pint->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroySurface(pint->display, pint->surface);
+	eglDestroyContext(pint->display, pint->context);
+	eglTerminate(pint->display);
+	free(pint);
+}
+
+static EGLDisplay get_egl_display(struct pint *p)
+{
+	struct headless_pint *pint = HEADLESS_PINT(p);
+
+	return pint->display;
+}
+
+static void set_swap_interval(struct pint *p, int interval)
+{
+	p = NULL;
+}
+
+static EGLDisplay get_display(void)
+{
+	const char *exts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display;
+
+	if (exts && strstr(exts, "EGL_MESA_platform_surfaceless")) {
+		get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (get_platform_display)
+			return get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	}
+
+	return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+struct pint *pint_initialise(uint32_t width, uint32_t height)
+{
+	static const EGLint attribute_list[] = {
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_ALPHA_SIZE, 8,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_NONE
+	};
+	EGLint context_attribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+	EGLint surface_attribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+	EGLConfig config;
+	EGLint num_config;
+
+	struct headless_pint *pint = calloc(1, sizeof(*pint));
+	if (!pint)
+		return NULL;
+
+	pint->base.swap_buffers = swap_buffers;
+	pint->base.terminate = terminate;
+	pint->base.should_end = should_end;
+	pint->base.get_egl_display = get_egl_display;
+	pint->base.set_swap_interval = set_swap_interval;
+
+	pint->display = get_display();
+	if (pint->display == EGL_NO_DISPLAY || !eglInitialize(pint->display, NULL, NULL)) {
+		fprintf(stderr, "Couldn't initialise EGL display\n");
+		goto fail;
+	}
+
+	if (!eglChooseConfig(pint->display, attribute_list, &config, 1, &num_config) || !num_config) {
+		fprintf(stderr, "No suitable EGL config\n");
+		goto fail;
+	}
+
+	eglBindAPI(EGL_OPENGL_ES_API);
+	pint->context = eglCreateContext(pint->display, config, EGL_NO_CONTEXT, context_attribs);
+	if (pint->context == EGL_NO_CONTEXT) {
+		fprintf(stderr, "Couldn't create EGL context\n");
+		goto fail;
+	}
+
+	pint->surface = eglCreatePbufferSurface(pint->display, config, surface_attribs);
+	if (pint->surface == EGL_NO_SURFACE) {
+		fprintf(stderr, "Couldn't create pbuffer\n");
+		goto fail;
+	}
+
+	if (!eglMakeCurrent(pint->display, pint->surface, pint->surface, pint->context)) {
+		fprintf(stderr, "Couldn't make context current\n");
+		goto fail;
+	}
+
+	return (struct pint *)pint;
+
+fail:
+	if (pint->display != EGL_NO_DISPLAY)
+		eglTerminate(pint->display);
+	free(pint);
+	return NULL;
+}
@@ -94,6 +94,13 @@ static EGLDisplay get_egl_display(struct pint *p)
 	return pint->display;
 }
 
+static void set_swap_interval(struct pint *p, int interval)
+{
+	struct piegl_pint *pint = PIEGL_PINT(p);
+
+	eglSwapInterval(pint->display, interval);
+}
+
 struct pint *pint_initialise(uint32_t width, uint32_t height)
 {
 	int32_t success = 0;
@@ -127,6 +134,7 @@ struct pint *pint_initialise(uint32_t width, uint32_t height)
 	pint->base.terminate = terminate;
 	pint->base.should_end = should_end;
 	pint->base.get_egl_display = get_egl_display;
+	pint->base.set_swap_interval = set_swap_interval;
 
 	// get an EGL display connection
 	pint->display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
@@ -0,0 +1,187 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <GLES2/gl2.h>
+
+#include "kernel.h"
+#include "reduce.h"
+#include "shader.h"
+
+#define REDUCE_FACTOR 4
+
+static const struct {
+	const char *name;
+	unsigned int flags;
+	bool reduce_x, reduce_y;
+} reduce_ops[N_REDUCE_OPS] = {
+	[REDUCE_MEAN]         = { "mean",     0,                      true,  true },
+	[REDUCE_MINMAX]       = { "minmax",   SHADER_REDUCE_MINMAX,   true,  true },
+	[REDUCE_CENTROID]     = { "centroid", SHADER_REDUCE_CENTROID, true,  true },
+	[REDUCE_ROW_CENTROID] = { "rows",     SHADER_REDUCE_CENTROID, true,  false },
+	[REDUCE_COL_CENTROID] = { "cols",     SHADER_REDUCE_CENTROID, false, true },
+};
+
+int reduce_op_from_name(const char *name)
+{
+	int i;
+
+	for (i = 0; i < N_REDUCE_OPS; i++) {
+		if (!strcmp(name, reduce_ops[i].name))
+			return i;
+	}
+
+	return -1;
+}
+
+static unsigned int reduce_factor(unsigned int size)
+{
+	return size < REDUCE_FACTOR ? size : REDUCE_FACTOR;
+}
+
+void reduce_free(struct reduce *reduce)
+{
+	unsigned int i;
+
+	if (!reduce)
+		return;
+
+	for (i = 0; i < reduce->npasses; i++) {
+		glDeleteFramebuffers(1, &reduce->passes[i]->fbo.handle);
+		glDeleteTextures(1, &reduce->passes[i]->fbo.texture);
+		glDeleteProgram(reduce->passes[i]->shader_program);
+		free(reduce->passes[i]);
+	}
+	free(reduce->buf);
+	free(reduce);
+}
+
+#define REDUCE_SLOT_THRESHOLD 0
+
+struct reduce *reduce_create(enum reduce_op op, const struct fbo *src, float threshold)
+{
+	unsigned int w = src->width, h = src->height, fx, fy;
+	unsigned int prod = 1, flags;
+	GLuint texture = src->texture;
+	struct reduce *reduce;
+	struct drawcall *dc;
+	GLint prog;
+
+	if (op >= N_REDUCE_OPS) {
+		fprintf(stderr, "Unknown reduce op %d\n", op);
+		return NULL;
+	}
+
+	reduce = calloc(1, sizeof(*reduce));
+	if (!reduce) {
+		return NULL;
+	}
+	reduce->op = op;
+
+	do {
+		if (reduce->npasses >= REDUCE_MAX_PASSES) {
+			fprintf(stderr, "Too many reduction passes for %dx%d\n",
+				src->width, src->height);
+			goto fail;
+		}
+
+		fx = reduce_ops[op].reduce_x ? reduce_factor(w) : 1;
+		fy = reduce_ops[op].reduce_y ? reduce_factor(h) : 1;
+		prod *= fx * fy;
+
+		/*
+		 * The first pass turns pixels into values, the rest just combine
+		 * them. Each pass needs its own program, as texel and factor
+		 * differ between passes.
+		 */
+		flags = reduce_ops[op].flags & SHADER_REDUCE_MINMAX;
+		if (!reduce->npasses) {
+			flags = reduce_ops[op].flags | SHADER_REDUCE_FIRST;
+		}
+		prog = kernel_program("reduce_fs.glsl", flags);
+		if (prog < 0) {
+			goto fail;
+		}
+
+		dc = kernel_quad_drawcall(prog, texture, (w + fx - 1) / fx, (h + fy - 1) / fy);
+		if (!dc) {
+			glDeleteProgram(prog);
+			goto fail;
+		}
+		reduce->passes[reduce->npasses++] = dc;
+
+		glUseProgram(prog);
+		glUniform2f(glGetUniformLocation(prog, "texel"), 1.0f / w, 1.0f / h);
+		glUniform2f(glGetUniformLocation(prog, "factor"), fx, fy);
+		glUseProgram(0);
+
+		w = dc->fbo.width;
+		h = dc->fbo.height;
+		texture = dc->fbo.texture;
+	} while ((reduce_ops[op].reduce_x && w > 1) || (reduce_ops[op].reduce_y && h > 1));
+
+	/* Only the first pass thresholds, and it can change per-frame */
+	dc = reduce->passes[0];
+	if (drawcall_uniform(dc, "threshold", UNIFORM_1f) != REDUCE_SLOT_THRESHOLD) {
+		goto fail;
+	}
+	reduce_set_threshold(reduce, threshold);
+
+	reduce->width = w;
+	reduce->height = h;
+	reduce->scale = (float)prod * w * h / (src->width * src->height);
+
+	reduce->buf = malloc(w * h * 4);
+	if (!reduce->buf) {
+		goto fail;
+	}
+
+	return reduce;
+
+fail:
+	reduce_free(reduce);
+	return NULL;
+}
+
+void reduce_set_threshold(struct reduce *reduce, float threshold)
+{
+	drawcall_set_uniform(reduce->passes[0], REDUCE_SLOT_THRESHOLD, &threshold);
+}
+
+unsigned int reduce_read(struct reduce *reduce, struct reduce_value *vals)
+{
+	struct drawcall *last = reduce->passes[reduce->npasses - 1];
+	unsigned int i, n = reduce->width * reduce->height;
+	float r, g, b;
+
+	fbo_readback(&last->fbo, reduce->buf);
+
+	for (i = 0; i < n; i++) {
+		r = reduce->buf[i * 4] / 255.0f;
+		g = reduce->buf[i * 4 + 1] / 255.0f;
+		b = reduce->buf[i * 4 + 2] / 255.0f;
+
+		switch (reduce->op) {
+		case REDUCE_MEAN:
+			vals[i] = (struct reduce_value){{ r * reduce->scale, g * reduce->scale, b * reduce->scale }};
+			break;
+		case REDUCE_MINMAX:
+			vals[i] = (struct reduce_value){{ r, g, 0.0f }};
+			break;
+		default:
+			/* The sums share a scale, so it cancels in the ratios */
+			if (reduce->buf[i * 4] == 0) {
+				vals[i] = (struct reduce_value){{ -1.0f, -1.0f, 0.0f }};
+			} else {
+				vals[i] = (struct reduce_value){{ g / r, b / r, r * reduce->scale }};
+			}
+			break;
+		}
+	}
+
+	return n;
+}
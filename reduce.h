@@ -0,0 +1,71 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#ifndef __REDUCE_H__
+#define __REDUCE_H__
+#include <stdint.h>
+
+#include <GLES2/gl2.h>
+
+#include "drawcall.h"
+#include "types.h"
+
+/*
+ * Reductions collapse an FBO on the GPU through a chain of render passes,
+ * each shrinking the image by up to 4x in each direction, so only the
+ * final few pixels need reading back.
+ *
+ * Intermediate results are 8 bits per channel, so values are only good to
+ * about 1/255, and very sparse masks in large images can vanish entirely.
+ */
+enum reduce_op {
+	REDUCE_MEAN = 0,
+	REDUCE_MINMAX,
+	/* Intensity-weighted centroid of the pixels brighter than threshold */
+	REDUCE_CENTROID,
+	/* As REDUCE_CENTROID, but one result per row/column */
+	REDUCE_ROW_CENTROID,
+	REDUCE_COL_CENTROID,
+	N_REDUCE_OPS,
+};
+
+/*
+ * REDUCE_MEAN:      v = mean r, g, b
+ * REDUCE_MINMAX:    v = min luma, max luma
+ * REDUCE_*CENTROID: v = x, y (0-1, origin top-left), mean weight (0-1).
+ *                   x and y are -1 if nothing passed the threshold.
+ */
+struct reduce_value {
+	float v[3];
+};
+
+#define REDUCE_MAX_PASSES 8
+
+struct reduce {
+	enum reduce_op op;
+	unsigned int npasses;
+	struct drawcall *passes[REDUCE_MAX_PASSES];
+
+	/* Size of the result: 1x1, 1 x rows or columns x 1 */
+	unsigned int width, height;
+	/* Undoes the normalisation of the sums */
+	float scale;
+	uint8_t *buf;
+};
+
+struct reduce *reduce_create(enum reduce_op op, const struct fbo *src, float threshold);
+void reduce_free(struct reduce *reduce);
+
+/* Takes effect from the next draw of the passes */
+void reduce_set_threshold(struct reduce *reduce, float threshold);
+
+/*
+ * Read back the result after all of reduce->passes have been drawn.
+ * vals must hold width * height values. Returns the number of values.
+ */
+unsigned int reduce_read(struct reduce *reduce, struct reduce_value *vals);
+
+/* Look up an op by name ("mean", "rows", ...). Returns -1 if unknown */
+int reduce_op_from_name(const char *name);
+
+#endif /* __REDUCE_H__ */
@@ -0,0 +1,62 @@
+#version 100
+#ifdef MEDIUMP
+#define PREC mediump
+#else
+#define PREC highp
+#endif
+precision PREC float;
+uniform sampler2D tex;
+uniform highp vec2 texel;
+// Source texels per output pixel in each direction, at most 4
+uniform highp vec2 factor;
+uniform PREC float threshold;
+
+// Each output pixel collapses a factor.x * factor.y block of the source.
+// Samples past the edge of the source are skipped, and sums are always
+// divided by the full block size, so the CPU can undo the scaling exactly.
+//
+// REDUCE_FIRST converts the image into the values to reduce:
+//   default:         rgb
+//   REDUCE_MINMAX:   (luma, luma)
+//   REDUCE_CENTROID: (w, w * x, w * y), w = luma above threshold, else 0
+// Later passes average them, or take (min, max) with REDUCE_MINMAX.
+
+void main()
+{
+	highp vec2 base = floor(gl_FragCoord.xy) * factor;
+#ifdef REDUCE_MINMAX
+	vec3 acc = vec3(1.0, 0.0, 0.0);
+#else
+	vec3 acc = vec3(0.0);
+#endif
+
+	for (int j = 0; j < 4; j++) {
+		for (int i = 0; i < 4; i++) {
+			highp vec2 tc = (base + vec2(float(i), float(j)) + 0.5) * texel;
+
+			if (float(i) < factor.x && float(j) < factor.y &&
+			    tc.x < 1.0 && tc.y < 1.0) {
+				vec3 s = texture2D(tex, tc).rgb;
+#ifdef REDUCE_FIRST
+				float l = dot(s, vec3(0.299, 0.587, 0.114));
+#if defined(REDUCE_MINMAX)
+				s = vec3(l, l, 0.0);
+#elif defined(REDUCE_CENTROID)
+				l *= step(threshold, l);
+				s = vec3(l, l * tc);
+#endif
+#endif
+#ifdef REDUCE_MINMAX
+				acc = vec3(min(acc.r, s.r), max(acc.g, s.g), 0.0);
+#else
+				acc += s;
+#endif
+			}
+		}
+	}
+
+#ifndef REDUCE_MINMAX
+	acc /= factor.x * factor.y;
+#endif
+	gl_FragColor = vec4(acc, 1.0);
+}
@@ -11,6 +11,24 @@
 
 #include <GLES2/gl2.h>
 
+#include "shader.h"
+
+static const struct {
+	unsigned int flag;
+	const char *define;
+} shader_defines[] = {
+	{ SHADER_LUMA_ONLY, "LUMA_ONLY" },
+	{ SHADER_MEDIUMP, "MEDIUMP" },
+	{ SHADER_GREYSCALE, "GREYSCALE" },
+	{ SHADER_PACKED_UV, "PACKED_UV" },
+	{ SHADER_DILATE, "DILATE" },
+	{ SHADER_REDUCE_FIRST, "REDUCE_FIRST" },
+	{ SHADER_REDUCE_MINMAX, "REDUCE_MINMAX" },
+	{ SHADER_REDUCE_CENTROID, "REDUCE_CENTROID" },
+	{ SHADER_LUT, "LUT" },
+};
+#define N_SHADER_DEFINES (sizeof(shader_defines) / sizeof(shader_defines[0]))
+
 char *shader_load(const char *filename)
 {
 	int ret;
@@ -105,3 +123,59 @@ GLint shader_compile(const char *vertex_shader_source, const char *fragment_shad
 	glDeleteShader(fragment_shader);
 	return shader_program;
 }
+
+char *shader_specialise(const char *source, unsigned int flags)
+{
+	const char *body = source;
+	size_t len = strlen(source) + 1;
+	char *shader, *cursor;
+	int i;
+
+	for (i = 0; i < N_SHADER_DEFINES; i++) {
+		if (flags & shader_defines[i].flag) {
+			len += strlen("#define \n") + strlen(shader_defines[i].define);
+		}
+	}
+
+	shader = malloc(len);
+	if (!shader) {
+		fprintf(stderr, "Couldn't alloc shader\n");
+		return NULL;
+	}
+
+	/* #version has to stay first, so the defines go after it */
+	if (!strncmp(source, "#version", strlen("#version"))) {
+		body = strchr(source, '\n');
+		body = body ? body + 1 : source + strlen(source);
+	}
+
+	memcpy(shader, source, body - source);
+	cursor = shader + (body - source);
+
+	for (i = 0; i < N_SHADER_DEFINES; i++) {
+		if (flags & shader_defines[i].flag) {
+			cursor += sprintf(cursor, "#define %s\n", shader_defines[i].define);
+		}
+	}
+
+	strcpy(cursor, body);
+
+	return shader;
+}
+
+GLint shader_compile_variant(const char *vertex_shader_source, const char *fragment_shader_source,
+			     unsigned int flags)
+{
+	char *vs, *fs;
+	GLint ret = -1;
+
+	vs = shader_specialise(vertex_shader_source, flags);
+	fs = shader_specialise(fragment_shader_source, flags);
+	if (vs && fs) {
+		ret = shader_compile(vs, fs);
+	}
+
+	free(vs);
+	free(fs);
+	return ret;
+}
@@ -7,8 +7,27 @@
 #ifndef __SHADER_H__
 #define __SHADER_H__
 
+/*
+ * Variant flags. Each one turns into a #define injected after the
+ * #version line, and the shader sources #ifdef on them.
+ */
+#define SHADER_LUMA_ONLY       (1 << 0) /* Sample only the Y plane */
+#define SHADER_MEDIUMP         (1 << 1) /* mediump for colour maths */
+#define SHADER_GREYSCALE       (1 << 2) /* Write grey instead of RGB */
+#define SHADER_PACKED_UV       (1 << 3) /* U and V interleaved in utex (.ra) */
+#define SHADER_DILATE          (1 << 4) /* morph_fs: dilate rather than erode */
+#define SHADER_REDUCE_FIRST    (1 << 5) /* reduce_fs: first pass, reads an image */
+#define SHADER_REDUCE_MINMAX   (1 << 6) /* reduce_fs: min/max of luma */
+#define SHADER_REDUCE_CENTROID (1 << 7) /* reduce_fs: thresholded centroid */
+#define SHADER_LUT             (1 << 8) /* YUV->RGB through a 3D LUT, see lut.h */
+
 char *shader_load(const char *filename);
 
+/* Returns a newly allocated copy of source with the variant defines added */
+char *shader_specialise(const char *source, unsigned int flags);
+
 GLint shader_compile(const char *vertex_shader_source, const char *fragment_shader_source);
+GLint shader_compile_variant(const char *vertex_shader_source, const char *fragment_shader_source,
+			     unsigned int flags);
 
 #endif /* __SHADER_H__ */
@@ -0,0 +1,40 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+
+#ifndef __SINK_H__
+#define __SINK_H__
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * A sink is somewhere processed frames go once they've been read back
+ * from the GPU. Frames are tightly-packed RGBA, as from fbo_readback().
+ */
+struct sink {
+	/*
+	 * Get a buffer to read a width x height frame into. Returns NULL if
+	 * there's nowhere to put it, in which case the frame is dropped
+	 */
+	void *(*dequeue)(struct sink *s, uint32_t width, uint32_t height);
+	/* Publish the buffer from the last dequeue(). timestamp is in ns */
+	void (*queue)(struct sink *s, uint64_t timestamp);
+	void (*terminate)(struct sink *s);
+};
+
+/*
+ * Publish frames into a POSIX shared memory ring called name (see
+ * sink_shm.h for the layout), big enough for max_width x max_height.
+ */
+struct sink *sink_shm_init(const char *name, unsigned int nslots,
+			   uint32_t max_width, uint32_t max_height);
+
+/*
+ * Append frames to the file at path (see sink_record.h for the layout).
+ * A writer thread does the I/O, with up to nslots frames in flight;
+ * frames are dropped rather than waiting for it.
+ */
+struct sink *sink_record_init(const char *path, unsigned int nslots,
+			      uint32_t max_width, uint32_t max_height);
+
+#endif /* __SINK_H__ */
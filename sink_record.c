@@ -0,0 +1,285 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sink.h"
+#include "sink_record.h"
+#include "stats.h"
+#include "trace.h"
+
+#define ALIGN_UP(_size, _base) ((((_size) + ((_base) - 1))) & (~((_base) - 1)))
+
+/* Make sure the file size is on disk at least this often */
+#define SYNC_FRAMES 32
+
+struct sink_record {
+	struct sink base;
+
+	int fd;
+	uint32_t max_width, max_height;
+	size_t record_size;
+
+	/*
+	 * Single-producer, single-consumer ring. The render thread fills
+	 * bufs[head % nslots] and bumps head, the writer thread writes
+	 * bufs[tail % nslots] out and bumps tail. ready counts queued frames.
+	 */
+	unsigned int nslots;
+	void **bufs;
+	uint64_t head, tail;
+	sem_t ready;
+	bool stop;
+	/* Set by the writer when the file can't be written any more */
+	bool failed;
+
+	uint64_t frame;
+	uint32_t dropped;
+	struct sink_record_frame *slot;
+
+	pthread_t thread;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t ret;
+	int flags;
+
+	while (len) {
+		ret = write(fd, p, len);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		} else if (ret < 0 && errno == EINVAL) {
+			/* Some filesystems accept O_DIRECT at open() but not write() */
+			flags = fcntl(fd, F_GETFL);
+			if (!(flags & O_DIRECT) || fcntl(fd, F_SETFL, flags & ~O_DIRECT))
+				return -1;
+			continue;
+		} else if (ret <= 0) {
+			return -1;
+		}
+		p += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+static void *writer_thread(void *arg)
+{
+	struct sink_record *sink = arg;
+	uint64_t head, start;
+
+	trace_thread_name("record");
+
+	for (;;) {
+		while (sem_wait(&sink->ready) && errno == EINTR);
+
+		head = __atomic_load_n(&sink->head, __ATOMIC_ACQUIRE);
+		if (sink->tail == head) {
+			if (__atomic_load_n(&sink->stop, __ATOMIC_ACQUIRE))
+				break;
+			continue;
+		}
+
+		if (!__atomic_load_n(&sink->failed, __ATOMIC_RELAXED)) {
+			trace_begin("write");
+			start = now_ns();
+			if (write_all(sink->fd, sink->bufs[sink->tail % sink->nslots], sink->record_size)) {
+				fprintf(stderr, "Recording failed: %s\n", strerror(errno));
+				__atomic_store_n(&sink->failed, true, __ATOMIC_RELAXED);
+			} else if ((sink->tail % SYNC_FRAMES) == SYNC_FRAMES - 1) {
+				fdatasync(sink->fd);
+			}
+			stats_record(STATS_WRITE, now_ns() - start);
+			trace_end("write");
+		}
+
+		/* Hand the buffer back to the render thread */
+		__atomic_store_n(&sink->tail, sink->tail + 1, __ATOMIC_RELEASE);
+	}
+
+	fdatasync(sink->fd);
+
+	return NULL;
+}
+
+static void free_bufs(struct sink_record *sink)
+{
+	unsigned int i;
+
+	if (!sink->bufs)
+		return;
+
+	for (i = 0; i < sink->nslots; i++) {
+		free(sink->bufs[i]);
+	}
+	free(sink->bufs);
+}
+
+static void terminate(struct sink *s)
+{
+	struct sink_record *sink = (struct sink_record *)s;
+
+	/* Anything already queued still gets written */
+	__atomic_store_n(&sink->stop, true, __ATOMIC_RELEASE);
+	sem_post(&sink->ready);
+	pthread_join(sink->thread, NULL);
+
+	if (sink->dropped)
+		fprintf(stderr, "Recording dropped %u frames at the end\n", sink->dropped);
+
+	close(sink->fd);
+	sem_destroy(&sink->ready);
+	free_bufs(sink);
+	free(sink);
+}
+
+static void *dequeue(struct sink *s, uint32_t width, uint32_t height)
+{
+	struct sink_record *sink = (struct sink_record *)s;
+	struct sink_record_frame *slot;
+	uint64_t tail = __atomic_load_n(&sink->tail, __ATOMIC_ACQUIRE);
+
+	if (width > sink->max_width || height > sink->max_height) {
+		fprintf(stderr, "Frame %dx%d too big for recording\n", width, height);
+		return NULL;
+	}
+
+	/* The writer is behind (or gave up), so this frame is lost */
+	if (sink->head - tail >= sink->nslots ||
+	    __atomic_load_n(&sink->failed, __ATOMIC_RELAXED)) {
+		sink->frame++;
+		sink->dropped++;
+		return NULL;
+	}
+
+	slot = sink->bufs[sink->head % sink->nslots];
+	slot->magic = SINK_RECORD_FRAME_MAGIC;
+	slot->width = width;
+	slot->height = height;
+	slot->stride = width * 4;
+	slot->frame = sink->frame;
+	slot->dropped = sink->dropped;
+	sink->slot = slot;
+
+	return slot + 1;
+}
+
+static void queue(struct sink *s, uint64_t timestamp)
+{
+	struct sink_record *sink = (struct sink_record *)s;
+
+	if (!sink->slot)
+		return;
+
+	sink->slot->timestamp = timestamp;
+	__atomic_store_n(&sink->head, sink->head + 1, __ATOMIC_RELEASE);
+	sem_post(&sink->ready);
+
+	sink->frame++;
+	sink->dropped = 0;
+	sink->slot = NULL;
+}
+
+struct sink *sink_record_init(const char *path, unsigned int nslots,
+			      uint32_t max_width, uint32_t max_height)
+{
+	struct sink_record_header *hdr = NULL;
+	unsigned int i;
+	int ret;
+
+	struct sink_record *sink = calloc(1, sizeof(*sink));
+	if (!sink)
+		return NULL;
+
+	sink->nslots = nslots;
+	sink->max_width = max_width;
+	sink->max_height = max_height;
+	sink->record_size = ALIGN_UP(sizeof(struct sink_record_frame) +
+				     (size_t)max_width * max_height * 4, SINK_RECORD_ALIGN);
+
+	/* O_DIRECT keeps the page cache (and its writeback stalls) out of it */
+	sink->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+	if (sink->fd < 0 && errno == EINVAL) {
+		fprintf(stderr, "No O_DIRECT for %s, recording will be buffered\n", path);
+		sink->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	}
+	if (sink->fd < 0) {
+		fprintf(stderr, "Couldn't open %s: %s\n", path, strerror(errno));
+		free(sink);
+		return NULL;
+	}
+
+	sink->bufs = calloc(nslots, sizeof(*sink->bufs));
+	if (!sink->bufs)
+		goto fail;
+
+	for (i = 0; i < nslots; i++) {
+		if (posix_memalign(&sink->bufs[i], SINK_RECORD_ALIGN, sink->record_size))
+			goto fail;
+		memset(sink->bufs[i], 0, sink->record_size);
+	}
+
+	if (posix_memalign((void **)&hdr, SINK_RECORD_ALIGN, SINK_RECORD_ALIGN))
+		goto fail;
+	memset(hdr, 0, SINK_RECORD_ALIGN);
+	hdr->magic = SINK_RECORD_MAGIC;
+	hdr->version = SINK_RECORD_VERSION;
+	hdr->width = max_width;
+	hdr->height = max_height;
+	hdr->stride = max_width * 4;
+	hdr->record_size = sink->record_size;
+	hdr->data_offset = sizeof(struct sink_record_frame);
+	hdr->start = now_ns();
+
+	if (write_all(sink->fd, hdr, SINK_RECORD_ALIGN)) {
+		fprintf(stderr, "Couldn't write %s: %s\n", path, strerror(errno));
+		goto fail;
+	}
+	free(hdr);
+	hdr = NULL;
+
+	if (sem_init(&sink->ready, 0, 0)) {
+		fprintf(stderr, "Couldn't create semaphore: %s\n", strerror(errno));
+		goto fail;
+	}
+
+	ret = pthread_create(&sink->thread, NULL, writer_thread, sink);
+	if (ret) {
+		fprintf(stderr, "Couldn't create writer thread: %s\n", strerror(ret));
+		sem_destroy(&sink->ready);
+		goto fail;
+	}
+
+	sink->base.dequeue = dequeue;
+	sink->base.queue = queue;
+	sink->base.terminate = terminate;
+
+	return &sink->base;
+
+fail:
+	free(hdr);
+	close(sink->fd);
+	free_bufs(sink);
+	free(sink);
+	return NULL;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ *
+ * File layout written by sink_record. Everything is in native byte order
+ * and padded to SINK_RECORD_ALIGN, so that it can be written with
+ * O_DIRECT.
+ *
+ * The file starts with a struct sink_record_header, padded to
+ * SINK_RECORD_ALIGN bytes. It's followed by fixed-size records of
+ * header->record_size bytes each: a struct sink_record_frame, then the
+ * tightly-packed RGBA pixels at header->data_offset into the record.
+ * Record n is at (n + 1) * header->record_size, so a reader can seek
+ * straight to it.
+ *
+ * A file cut short (e.g. by power loss) just ends in a partial record,
+ * which a reader can spot by a bad magic or by running out of file.
+ */
+#ifndef __SINK_RECORD_H__
+#define __SINK_RECORD_H__
+#include <stdint.h>
+
+#define SINK_RECORD_MAGIC       0x43455246 /* "FREC" */
+#define SINK_RECORD_FRAME_MAGIC 0x4d415246 /* "FRAM" */
+#define SINK_RECORD_VERSION     1
+#define SINK_RECORD_ALIGN       4096
+
+struct sink_record_header {
+	uint32_t magic, version;
+	uint32_t width, height, stride;
+	uint32_t record_size;
+	uint32_t data_offset;
+	uint32_t pad;
+	/* CLOCK_MONOTONIC when recording started, in ns */
+	uint64_t start;
+};
+
+struct sink_record_frame {
+	uint32_t magic;
+	uint32_t width, height, stride;
+	/* Frame number as queued, counting any frames which were dropped */
+	uint64_t frame;
+	/* Capture timestamp, in ns */
+	uint64_t timestamp;
+	/* Frames dropped between the previous record and this one */
+	uint32_t dropped;
+	uint8_t pad[28];
+} __attribute__((aligned(64)));
+
+#endif /* __SINK_RECORD_H__ */
@@ -0,0 +1,154 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "sink.h"
+#include "sink_shm.h"
+
+#define ALIGN_UP(_size, _base) ((((_size) + ((_base) - 1))) & (~((_base) - 1)))
+
+struct sink_shm {
+	struct sink base;
+
+	char name[NAME_MAX];
+	struct sink_shm_header *hdr;
+	size_t size;
+
+	uint64_t frame;
+	struct sink_shm_slot *slot;
+};
+
+static void terminate(struct sink *s)
+{
+	struct sink_shm *sink = (struct sink_shm *)s;
+
+	munmap(sink->hdr, sink->size);
+	shm_unlink(sink->name);
+	free(sink);
+}
+
+static void *dequeue(struct sink *s, uint32_t width, uint32_t height)
+{
+	struct sink_shm *sink = (struct sink_shm *)s;
+	struct sink_shm_header *hdr = sink->hdr;
+	struct sink_shm_slot *slot = &hdr->slots[sink->frame % hdr->nslots];
+	uint32_t stride = width * 4;
+
+	if ((size_t)stride * height > hdr->slot_size) {
+		fprintf(stderr, "Frame %dx%d too big for shm slot\n", width, height);
+		return NULL;
+	}
+
+	/* Make it odd - readers will see the slot is being written */
+	__atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	slot->width = width;
+	slot->height = height;
+	slot->stride = stride;
+	slot->frame = sink->frame;
+	sink->slot = slot;
+
+	return (char *)hdr + slot->offset;
+}
+
+static void queue(struct sink *s, uint64_t timestamp)
+{
+	struct sink_shm *sink = (struct sink_shm *)s;
+	struct sink_shm_header *hdr = sink->hdr;
+	struct sink_shm_slot *slot = sink->slot;
+
+	if (!slot)
+		return;
+
+	slot->timestamp = timestamp;
+	__atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&hdr->latest, sink->frame, __ATOMIC_RELEASE);
+	/*
+	 * Only pay for the syscall if someone is actually waiting. SEQ_CST
+	 * pairs with sink_shm_wait(), so the wake can't be lost.
+	 */
+	__atomic_add_fetch(&hdr->futex, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&hdr->waiters, __ATOMIC_SEQ_CST))
+		syscall(SYS_futex, &hdr->futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+
+	sink->frame++;
+	sink->slot = NULL;
+}
+
+struct sink *sink_shm_init(const char *name, unsigned int nslots,
+			   uint32_t max_width, uint32_t max_height)
+{
+	struct sink_shm_header *hdr;
+	size_t hdr_size, slot_size;
+	unsigned int i;
+	int fd;
+
+	struct sink_shm *sink = calloc(1, sizeof(*sink));
+	if (!sink)
+		return NULL;
+
+	snprintf(sink->name, sizeof(sink->name), "%s%s", name[0] == '/' ? "" : "/", name);
+
+	hdr_size = ALIGN_UP(sizeof(*hdr) + sizeof(hdr->slots[0]) * nslots, 4096);
+	slot_size = ALIGN_UP((size_t)max_width * max_height * 4, 4096);
+	sink->size = hdr_size + slot_size * nslots;
+
+	fd = shm_open(sink->name, O_RDWR | O_CREAT | O_TRUNC, 0660);
+	if (fd < 0) {
+		fprintf(stderr, "Couldn't open shm %s: %s\n", sink->name, strerror(errno));
+		free(sink);
+		return NULL;
+	}
+
+	/* Consumers need to write waiters, whatever the umask says */
+	if (fchmod(fd, 0660)) {
+		fprintf(stderr, "Couldn't chmod shm %s: %s\n", sink->name, strerror(errno));
+		goto fail;
+	}
+
+	if (ftruncate(fd, sink->size)) {
+		fprintf(stderr, "Couldn't size shm %s: %s\n", sink->name, strerror(errno));
+		goto fail;
+	}
+
+	hdr = mmap(NULL, sink->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (hdr == MAP_FAILED) {
+		fprintf(stderr, "Couldn't map shm %s: %s\n", sink->name, strerror(errno));
+		goto fail;
+	}
+	close(fd);
+
+	hdr->version = SINK_SHM_VERSION;
+	hdr->nslots = nslots;
+	hdr->slot_size = slot_size;
+	hdr->latest = UINT64_MAX;
+	for (i = 0; i < nslots; i++) {
+		hdr->slots[i].offset = hdr_size + slot_size * i;
+	}
+	/* Magic last, so consumers don't see a half-initialised header */
+	__atomic_store_n(&hdr->magic, SINK_SHM_MAGIC, __ATOMIC_RELEASE);
+
+	sink->hdr = hdr;
+	sink->base.dequeue = dequeue;
+	sink->base.queue = queue;
+	sink->base.terminate = terminate;
+
+	return &sink->base;
+
+fail:
+	close(fd);
+	shm_unlink(sink->name);
+	free(sink);
+	return NULL;
+}
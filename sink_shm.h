@@ -0,0 +1,87 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ *
+ * Shared memory layout used by sink_shm. This header is all a consumer
+ * needs: shm_open() the name O_RDWR, mmap() it PROT_READ | PROT_WRITE
+ * with MAP_SHARED, and then either poll header->latest or wait with
+ * sink_shm_wait(). The object is created 0660, so consumers need to run
+ * as the same user or group as the producer.
+ *
+ * The only thing consumers write is header->waiters, and only through
+ * sink_shm_wait(). Frames and the rest of the header are the producer's.
+ *
+ * Each slot is protected by a sequence count. It's odd while the
+ * producer is writing the slot, and bumped again once the frame is
+ * complete. A consumer reads seq, reads the frame (in place, no copy
+ * needed), then reads seq again: if it changed or was odd, the frame was
+ * overwritten underneath it and should be discarded.
+ */
+#ifndef __SINK_SHM_H__
+#define __SINK_SHM_H__
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#define SINK_SHM_MAGIC   0x4d524653 /* "SFRM" */
+#define SINK_SHM_VERSION 1
+
+struct sink_shm_slot {
+	uint32_t seq;
+	uint32_t width, height, stride;
+	/* Frame number and capture timestamp (ns) */
+	uint64_t frame;
+	uint64_t timestamp;
+	/* Offset of the pixel data from the start of the mapping */
+	uint64_t offset;
+	uint8_t pad[24];
+} __attribute__((aligned(64)));
+
+struct sink_shm_header {
+	uint32_t magic, version;
+	uint32_t nslots;
+	uint32_t slot_size;
+
+	/*
+	 * Number of the newest complete frame, in slot
+	 * (latest % nslots). UINT64_MAX until the first frame.
+	 */
+	uint64_t latest;
+
+	/*
+	 * Incremented on every frame. Consumers FUTEX_WAIT on it while
+	 * counted in waiters, so that the producer knows to FUTEX_WAKE. See
+	 * sink_shm_wait().
+	 */
+	uint32_t futex;
+	uint32_t waiters;
+
+	uint8_t pad[32];
+
+	struct sink_shm_slot slots[];
+} __attribute__((aligned(64)));
+
+/*
+ * Wait for header->futex to move on from seen (a value read from it
+ * earlier), or for timeout (NULL for forever). Returns the new value.
+ *
+ * The producer increments futex and then reads waiters, and this
+ * increments waiters and then reads futex. All four are SEQ_CST, so that
+ * at least one side sees the other's write: either the producer wakes us,
+ * or we see the new frame and don't sleep. A consumer which dies while
+ * waiting leaves waiters raised, which only costs the producer a syscall
+ * per frame.
+ */
+static inline uint32_t sink_shm_wait(struct sink_shm_header *hdr, uint32_t seen,
+				     const struct timespec *timeout)
+{
+	__atomic_add_fetch(&hdr->waiters, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&hdr->futex, __ATOMIC_SEQ_CST) == seen)
+		syscall(SYS_futex, &hdr->futex, FUTEX_WAIT, seen, timeout, NULL, 0);
+	__atomic_sub_fetch(&hdr->waiters, 1, __ATOMIC_SEQ_CST);
+
+	return __atomic_load_n(&hdr->futex, __ATOMIC_ACQUIRE);
+}
+
+#endif /* __SINK_SHM_H__ */
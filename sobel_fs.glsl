@@ -0,0 +1,35 @@
+#version 100
+#ifdef MEDIUMP
+#define PREC mediump
+#else
+#define PREC highp
+#endif
+precision PREC float;
+varying highp vec2 v_TexCoord;
+uniform sampler2D tex;
+uniform highp vec2 texel;
+uniform float scale;
+
+float luma(float dx, float dy)
+{
+	vec3 c = texture2D(tex, v_TexCoord + vec2(dx, dy) * texel).rgb;
+	return dot(c, vec3(0.299, 0.587, 0.114));
+}
+
+void main()
+{
+	float tl = luma(-1.0, -1.0), t = luma(0.0, -1.0), tr = luma(1.0, -1.0);
+	float l = luma(-1.0, 0.0), r = luma(1.0, 0.0);
+	float bl = luma(-1.0, 1.0), b = luma(0.0, 1.0), br = luma(1.0, 1.0);
+
+	float gx = (tr + 2.0 * r + br) - (tl + 2.0 * l + bl);
+	float gy = (bl + 2.0 * b + br) - (tl + 2.0 * t + tr);
+	float mag = clamp(length(vec2(gx, gy)) * scale, 0.0, 1.0);
+
+#ifdef GREYSCALE
+	gl_FragColor = vec4(vec3(mag), 1.0);
+#else
+	// Magnitude in r, signed gradients biased into g and b
+	gl_FragColor = vec4(mag, gx * 0.25 + 0.5, gy * 0.25 + 0.5, 1.0);
+#endif
+}
@@ -0,0 +1,277 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "stats.h"
+
+struct stats_hist_data {
+	uint64_t count;
+	uint64_t sum_ns;
+	uint64_t max_ns;
+	uint64_t buckets[STATS_HIST_BUCKETS];
+};
+
+static const char *const counter_names[N_STATS_COUNTERS] = {
+	[STATS_FRAMES] = "frames",
+	[STATS_PRESENTED] = "presented",
+	[STATS_DROPPED] = "dropped",
+	[STATS_STILL] = "still",
+	[STATS_TIER_CHANGES] = "tier_changes",
+	[STATS_SKIPPED] = "skipped",
+	[STATS_DEADLINE_MISSES] = "deadline_misses",
+	[STATS_RECORD_DROPPED] = "record_dropped",
+};
+
+static const char *const gauge_names[N_STATS_GAUGES] = {
+	[STATS_MOTION] = "motion",
+	[STATS_TIER] = "tier",
+};
+
+static const char *const hist_names[N_STATS_HISTS] = {
+	[STATS_FRAME_TIME] = "frame_time",
+	[STATS_DEQUEUE_WAIT] = "dequeue_wait",
+	[STATS_READBACK] = "readback",
+	[STATS_LATENCY] = "latency",
+	[STATS_WRITE] = "write",
+};
+
+static struct {
+	uint64_t counters[N_STATS_COUNTERS];
+	struct stats_hist_data hists[N_STATS_HISTS];
+	/* Float bit patterns, so they can be stored atomically */
+	uint32_t gauges[N_STATS_GAUGES];
+	struct stats_hist_data passes[STATS_MAX_PASSES];
+	unsigned int npasses;
+	/* Float bit patterns, so they can be stored atomically */
+	uint32_t values[STATS_MAX_VALUES];
+	unsigned int nvalues;
+
+	struct timespec start;
+	char path[PATH_MAX];
+	int fd;
+	pthread_t thread;
+	bool serving;
+} stats;
+
+void stats_count(enum stats_counter counter, uint64_t n)
+{
+	__atomic_add_fetch(&stats.counters[counter], n, __ATOMIC_RELAXED);
+}
+
+void stats_set(enum stats_gauge gauge, float value)
+{
+	uint32_t bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	__atomic_store_n(&stats.gauges[gauge], bits, __ATOMIC_RELAXED);
+}
+
+static void hist_record(struct stats_hist_data *hist, uint64_t ns)
+{
+	uint64_t us = ns / 1000, max;
+	unsigned int bucket = 0;
+
+	while ((us >>= 1) && bucket < STATS_HIST_BUCKETS - 1)
+		bucket++;
+
+	__atomic_add_fetch(&hist->count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&hist->sum_ns, ns, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&hist->buckets[bucket], 1, __ATOMIC_RELAXED);
+
+	max = __atomic_load_n(&hist->max_ns, __ATOMIC_RELAXED);
+	while (ns > max &&
+	       !__atomic_compare_exchange_n(&hist->max_ns, &max, ns, true,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+void stats_record(enum stats_hist hist, uint64_t ns)
+{
+	hist_record(&stats.hists[hist], ns);
+}
+
+void stats_record_pass(unsigned int pass, uint64_t ns)
+{
+	unsigned int n;
+
+	if (pass >= STATS_MAX_PASSES)
+		return;
+
+	hist_record(&stats.passes[pass], ns);
+
+	n = __atomic_load_n(&stats.npasses, __ATOMIC_RELAXED);
+	while (pass >= n &&
+	       !__atomic_compare_exchange_n(&stats.npasses, &n, pass + 1, true,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+void stats_set_values(const float *values, unsigned int n)
+{
+	unsigned int i;
+	uint32_t bits;
+
+	if (n > STATS_MAX_VALUES)
+		n = STATS_MAX_VALUES;
+
+	for (i = 0; i < n; i++) {
+		memcpy(&bits, &values[i], sizeof(bits));
+		__atomic_store_n(&stats.values[i], bits, __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&stats.nvalues, n, __ATOMIC_RELAXED);
+}
+
+static void print_hist(FILE *fp, struct stats_hist_data *hist)
+{
+	uint64_t count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+	uint64_t sum = __atomic_load_n(&hist->sum_ns, __ATOMIC_RELAXED);
+	unsigned int i;
+
+	fprintf(fp, "{\"count\":%llu,\"mean_us\":%.1f,\"max_us\":%.1f,\"buckets\":[",
+		(unsigned long long)count, count ? sum / 1000.0 / count : 0.0,
+		__atomic_load_n(&hist->max_ns, __ATOMIC_RELAXED) / 1000.0);
+	for (i = 0; i < STATS_HIST_BUCKETS; i++) {
+		fprintf(fp, "%s%llu", i ? "," : "",
+			(unsigned long long)__atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED));
+	}
+	fprintf(fp, "]}");
+}
+
+static void print_snapshot(FILE *fp)
+{
+	unsigned int i, n;
+	struct timespec now;
+	uint32_t bits;
+	float val;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	fprintf(fp, "{\"uptime_s\":%.3f", (now.tv_sec - stats.start.tv_sec) +
+		(now.tv_nsec - stats.start.tv_nsec) / 1000000000.0);
+
+	for (i = 0; i < N_STATS_COUNTERS; i++) {
+		fprintf(fp, ",\"%s\":%llu", counter_names[i],
+			(unsigned long long)__atomic_load_n(&stats.counters[i], __ATOMIC_RELAXED));
+	}
+
+	for (i = 0; i < N_STATS_GAUGES; i++) {
+		bits = __atomic_load_n(&stats.gauges[i], __ATOMIC_RELAXED);
+		memcpy(&val, &bits, sizeof(val));
+		fprintf(fp, ",\"%s\":%g", gauge_names[i], val);
+	}
+
+	for (i = 0; i < N_STATS_HISTS; i++) {
+		fprintf(fp, ",\"%s\":", hist_names[i]);
+		print_hist(fp, &stats.hists[i]);
+	}
+
+	fprintf(fp, ",\"gpu_passes\":[");
+	n = __atomic_load_n(&stats.npasses, __ATOMIC_RELAXED);
+	for (i = 0; i < n; i++) {
+		fprintf(fp, "%s", i ? "," : "");
+		print_hist(fp, &stats.passes[i]);
+	}
+
+	fprintf(fp, "],\"values\":[");
+	n = __atomic_load_n(&stats.nvalues, __ATOMIC_RELAXED);
+	for (i = 0; i < n; i++) {
+		bits = __atomic_load_n(&stats.values[i], __ATOMIC_RELAXED);
+		memcpy(&val, &bits, sizeof(val));
+		fprintf(fp, "%s%g", i ? "," : "", val);
+	}
+	fprintf(fp, "]}\n");
+}
+
+static void *stats_thread(void *arg)
+{
+	char *buf;
+	size_t len;
+	FILE *fp;
+	int fd;
+
+	while (1) {
+		fd = accept(stats.fd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR)
+				continue;
+			/* stats_stop() shuts the socket down to get us here */
+			break;
+		}
+
+		/* Built up front, so a slow reader can't stall recording */
+		fp = open_memstream(&buf, &len);
+		if (fp) {
+			print_snapshot(fp);
+			fclose(fp);
+			if (send(fd, buf, len, MSG_NOSIGNAL) < 0)
+				fprintf(stderr, "Couldn't send stats: %s\n", strerror(errno));
+			free(buf);
+		}
+		close(fd);
+	}
+
+	return NULL;
+}
+
+int stats_serve(const char *path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int ret;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Stats socket path too long: %s\n", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+	clock_gettime(CLOCK_MONOTONIC, &stats.start);
+	snprintf(stats.path, sizeof(stats.path), "%s", path);
+
+	stats.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (stats.fd < 0) {
+		fprintf(stderr, "Couldn't create stats socket: %s\n", strerror(errno));
+		return -1;
+	}
+
+	unlink(path);
+	if (bind(stats.fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(stats.fd, 4)) {
+		fprintf(stderr, "Couldn't listen on %s: %s\n", path, strerror(errno));
+		goto fail;
+	}
+
+	ret = pthread_create(&stats.thread, NULL, stats_thread, NULL);
+	if (ret) {
+		fprintf(stderr, "Couldn't create stats thread: %s\n", strerror(ret));
+		unlink(path);
+		goto fail;
+	}
+	stats.serving = true;
+
+	return 0;
+
+fail:
+	close(stats.fd);
+	return -1;
+}
+
+void stats_stop(void)
+{
+	if (!stats.serving)
+		return;
+
+	shutdown(stats.fd, SHUT_RDWR);
+	pthread_join(stats.thread, NULL);
+	close(stats.fd);
+	unlink(stats.path);
+	stats.serving = false;
+}
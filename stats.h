@@ -0,0 +1,70 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#ifndef __STATS_H__
+#define __STATS_H__
+#include <stdint.h>
+
+/*
+ * Process-wide counters and latency histograms. Recording is lock-free
+ * (relaxed atomics), so it's safe from any thread and cheap enough for
+ * the render loop. Snapshots are served as one line of JSON to anything
+ * which connects to the stats socket.
+ */
+enum stats_counter {
+	STATS_FRAMES = 0,
+	STATS_PRESENTED,
+	/* Frames whose output couldn't be published */
+	STATS_DROPPED,
+	/* Frames with too little motion to be worth publishing */
+	STATS_STILL,
+	/* Quality tier changes made by the governor */
+	STATS_TIER_CHANGES,
+	/* Frames the feed captured, but which were never dequeued */
+	STATS_SKIPPED,
+	/* Frames whose results were later than the pacing deadline */
+	STATS_DEADLINE_MISSES,
+	/* Frames the recording couldn't keep up with */
+	STATS_RECORD_DROPPED,
+	N_STATS_COUNTERS,
+};
+
+enum stats_hist {
+	STATS_FRAME_TIME = 0,
+	STATS_DEQUEUE_WAIT,
+	STATS_READBACK,
+	/* From the frame's timestamp to its results being ready */
+	STATS_LATENCY,
+	/* Writing one frame to the recording, on the writer thread */
+	STATS_WRITE,
+	N_STATS_HISTS,
+};
+
+/* Latest-value measurements */
+enum stats_gauge {
+	/* Fraction of the image which moved */
+	STATS_MOTION = 0,
+	/* Current governor quality tier, 0 is the best */
+	STATS_TIER,
+	N_STATS_GAUGES,
+};
+
+#define STATS_MAX_PASSES 16
+#define STATS_MAX_VALUES 128
+
+/* Bucket i counts samples below 2^(i + 1) us; the last catches the rest */
+#define STATS_HIST_BUCKETS 24
+
+void stats_count(enum stats_counter counter, uint64_t n);
+void stats_record(enum stats_hist hist, uint64_t ns);
+void stats_set(enum stats_gauge gauge, float value);
+/* GPU time for one drawcall pass */
+void stats_record_pass(unsigned int pass, uint64_t ns);
+/* Publish application results (e.g. reductions) alongside the stats */
+void stats_set_values(const float *values, unsigned int n);
+
+/* Start serving snapshots on a Unix socket at path */
+int stats_serve(const char *path);
+void stats_stop(void);
+
+#endif /* __STATS_H__ */
@@ -1,17 +1,30 @@
 /*
  * Copyright Brian Starkey <stark3y@gmail.com> 2017
  */
+#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
+#ifdef HAVE_NETPBM
 #include <pam.h>
+#endif
+
+#include <GLES2/gl2.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
 
 #include "texture.h"
 
 #define ALIGN_UP(_size, _base) ((((_size) + ((_base) - 1))) & (~((_base) - 1)))
-struct texture *texture_load(const char *file)
+
+#ifdef HAVE_NETPBM
+static struct texture *texture_load_netpbm(const char *file)
 {
 	struct texture *tex;
 	struct pam inpam = { 0 };
@@ -69,3 +82,478 @@ struct texture *texture_load(const char *file)
 	fclose(fp);
 	return tex;
 }
+#endif /* HAVE_NETPBM */
+
+static const char *pnm_skip_space(const char *p, const char *end)
+{
+	while (p < end) {
+		if (*p == '#') {
+			while (p < end && *p != '\n')
+				p++;
+		} else if (isspace((unsigned char)*p)) {
+			p++;
+		} else {
+			break;
+		}
+	}
+
+	return p;
+}
+
+static const char *pnm_read_uint(const char *p, const char *end, unsigned int *val)
+{
+	unsigned int v = 0;
+
+	p = pnm_skip_space(p, end);
+	if (p >= end || !isdigit((unsigned char)*p))
+		return NULL;
+
+	while (p < end && isdigit((unsigned char)*p)) {
+		v = (v * 10) + (*p - '0');
+		p++;
+	}
+
+	*val = v;
+	return p;
+}
+
+/*
+ * Parse the header of a binary 8-bit PGM (P5) or PPM (P6). Returns the
+ * offset of the raster, or -1 if it's not something we handle natively.
+ */
+static long pnm_parse_header(const char *map, size_t len, unsigned int *width,
+			     unsigned int *height, unsigned int *ncmp)
+{
+	const char *p = map, *end = map + len;
+	unsigned int maxval;
+
+	if (len < 2 || map[0] != 'P')
+		return -1;
+
+	if (map[1] == '5')
+		*ncmp = 1;
+	else if (map[1] == '6')
+		*ncmp = 3;
+	else
+		return -1;
+
+	p += 2;
+	p = pnm_read_uint(p, end, width);
+	if (p)
+		p = pnm_read_uint(p, end, height);
+	if (p)
+		p = pnm_read_uint(p, end, &maxval);
+
+	/* Exactly one whitespace character separates the header and raster */
+	if (!p || p >= end || !isspace((unsigned char)*p))
+		return -1;
+	p++;
+
+	if (!*width || !*height || !maxval || maxval > 255)
+		return -1;
+
+	if ((size_t)(end - p) < (size_t)*width * *height * *ncmp)
+		return -1;
+
+	return p - map;
+}
+
+/*
+ * Fast path for binary PGM/PPM. The file is mmap()ed, and if the rows
+ * already meet GL's default 4-byte unpack alignment the texture data
+ * points straight into the mapping. Otherwise the rows are memcpy()ed
+ * into a padded buffer.
+ */
+static struct texture *texture_load_native(const char *file)
+{
+	struct texture *tex;
+	struct stat st;
+	unsigned int width, height, ncmp, row;
+	unsigned int stride, pitch;
+	long offset;
+	char *map;
+	int fd;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open %s: %s\n", file, strerror(errno));
+		return NULL;
+	}
+
+	if (fstat(fd, &st) || st.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Failed to map %s: %s\n", file, strerror(errno));
+		return NULL;
+	}
+
+	offset = pnm_parse_header(map, st.st_size, &width, &height, &ncmp);
+	if (offset < 0) {
+		munmap(map, st.st_size);
+		return NULL;
+	}
+
+	tex = calloc(1, sizeof(*tex));
+	if (!tex) {
+		munmap(map, st.st_size);
+		return NULL;
+	}
+
+	tex->width = width;
+	tex->height = height;
+	tex->ncmp = ncmp;
+
+	stride = width * ncmp;
+	pitch = ALIGN_UP(stride, 4);
+	tex->datalen = pitch * height;
+
+	if (stride == pitch) {
+		madvise(map, st.st_size, MADV_SEQUENTIAL);
+		tex->map = map;
+		tex->maplen = st.st_size;
+		tex->data = map + offset;
+		return tex;
+	}
+
+	tex->data = malloc(tex->datalen);
+	if (!tex->data) {
+		free(tex);
+		munmap(map, st.st_size);
+		return NULL;
+	}
+
+	for (row = 0; row < height; row++) {
+		memcpy(tex->data + row * pitch, map + offset + row * stride, stride);
+	}
+
+	munmap(map, st.st_size);
+	return tex;
+}
+
+struct texture *texture_load(const char *file)
+{
+	struct texture *tex = texture_load_native(file);
+	if (tex)
+		return tex;
+
+#ifdef HAVE_NETPBM
+	return texture_load_netpbm(file);
+#else
+	fprintf(stderr, "%s: unsupported image format\n", file);
+	return NULL;
+#endif
+}
+
+void texture_free(struct texture *tex)
+{
+	if (!tex)
+		return;
+
+	if (tex->map)
+		munmap(tex->map, tex->maplen);
+	else
+		free(tex->data);
+	free(tex);
+}
+
+int texture_save(const char *file, const struct texture *tex)
+{
+	unsigned int row, col;
+	unsigned int pitch = ALIGN_UP(tex->width * tex->ncmp, 4);
+	char *rowbuf = NULL;
+	int ret = 0;
+	FILE *fp;
+
+	if (tex->ncmp != 1 && tex->ncmp != 3 && tex->ncmp != 4) {
+		fprintf(stderr, "Can't save %d-component texture\n", tex->ncmp);
+		return -1;
+	}
+
+	fp = fopen(file, "wb");
+	if (!fp) {
+		fprintf(stderr, "Failed to open %s: %s\n", file, strerror(errno));
+		return -1;
+	}
+
+	if (tex->ncmp == 4) {
+		rowbuf = malloc(tex->width * 3);
+		if (!rowbuf) {
+			fclose(fp);
+			return -1;
+		}
+	}
+
+	fprintf(fp, "P%c\n%u %u\n255\n", tex->ncmp == 1 ? '5' : '6', tex->width, tex->height);
+
+	for (row = 0; row < tex->height && !ret; row++) {
+		const char *src = tex->data + row * pitch;
+
+		if (rowbuf) {
+			for (col = 0; col < tex->width; col++) {
+				rowbuf[col * 3 + 0] = src[col * 4 + 0];
+				rowbuf[col * 3 + 1] = src[col * 4 + 1];
+				rowbuf[col * 3 + 2] = src[col * 4 + 2];
+			}
+			src = rowbuf;
+		}
+
+		if (fwrite(src, tex->ncmp == 1 ? tex->width : tex->width * 3, 1, fp) != 1) {
+			fprintf(stderr, "Failed writing %s: %s\n", file, strerror(errno));
+			ret = -1;
+		}
+	}
+
+	free(rowbuf);
+	if (fclose(fp))
+		ret = -1;
+
+	return ret;
+}
+
+struct texture *texture_interleave(const struct texture *a, const struct texture *b)
+{
+	struct texture *tex;
+	unsigned int row, col;
+	unsigned int apitch, bpitch, pitch;
+
+	if (a->ncmp != 1 || b->ncmp != 1 ||
+	    a->width != b->width || a->height != b->height) {
+		fprintf(stderr, "Can only interleave matching single-component textures\n");
+		return NULL;
+	}
+
+	tex = calloc(1, sizeof(*tex));
+	if (!tex) {
+		return NULL;
+	}
+
+	tex->width = a->width;
+	tex->height = a->height;
+	tex->ncmp = 2;
+
+	apitch = ALIGN_UP(a->width, 4);
+	bpitch = ALIGN_UP(b->width, 4);
+	pitch = ALIGN_UP(tex->width * tex->ncmp, 4);
+	tex->datalen = pitch * tex->height;
+	tex->data = calloc(tex->datalen, 1);
+	if (!tex->data) {
+		free(tex);
+		return NULL;
+	}
+
+	for (row = 0; row < tex->height; row++) {
+		const char *asrc = a->data + row * apitch;
+		const char *bsrc = b->data + row * bpitch;
+		char *dst = tex->data + row * pitch;
+
+		for (col = 0; col < tex->width; col++, dst += 2) {
+			dst[0] = asrc[col];
+			dst[1] = bsrc[col];
+		}
+	}
+
+	return tex;
+}
+
+static GLenum texture_format(unsigned int ncmp)
+{
+	switch (ncmp) {
+	case 1:
+		return GL_LUMINANCE;
+	case 2:
+		return GL_LUMINANCE_ALPHA;
+	case 3:
+		return GL_RGB;
+	case 4:
+		return GL_RGBA;
+	default:
+		return 0;
+	}
+}
+
+GLuint texture_upload(struct texture *tex)
+{
+	GLenum format = texture_format(tex->ncmp);
+	GLuint handle;
+
+	if (!format) {
+		fprintf(stderr, "Unsupported component count %d\n", tex->ncmp);
+		return 0;
+	}
+
+	glGenTextures(1, &handle);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, handle);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, tex->width, tex->height, 0, format, GL_UNSIGNED_BYTE, tex->data);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	return handle;
+}
+
+struct texture_stream {
+	EGLDisplay display;
+	PFNEGLCREATESYNCKHRPROC create_sync;
+	PFNEGLDESTROYSYNCKHRPROC destroy_sync;
+	PFNEGLCLIENTWAITSYNCKHRPROC client_wait_sync;
+
+	unsigned int depth, nplanes, next;
+	struct texture_stream_plane planes[TEXTURE_STREAM_MAX_PLANES];
+	struct texture_set *sets;
+};
+
+static void texture_stream_init_fences(struct texture_stream *stream, EGLDisplay display)
+{
+	const char *exts;
+
+	if (display == EGL_NO_DISPLAY)
+		return;
+
+	exts = eglQueryString(display, EGL_EXTENSIONS);
+	if (!exts || !strstr(exts, "EGL_KHR_fence_sync"))
+		return;
+
+	stream->create_sync = (PFNEGLCREATESYNCKHRPROC)eglGetProcAddress("eglCreateSyncKHR");
+	stream->destroy_sync = (PFNEGLDESTROYSYNCKHRPROC)eglGetProcAddress("eglDestroySyncKHR");
+	stream->client_wait_sync = (PFNEGLCLIENTWAITSYNCKHRPROC)eglGetProcAddress("eglClientWaitSyncKHR");
+	if (!stream->create_sync || !stream->destroy_sync || !stream->client_wait_sync) {
+		stream->create_sync = NULL;
+		return;
+	}
+
+	stream->display = display;
+}
+
+struct texture_stream *texture_stream_create(EGLDisplay display, unsigned int depth,
+					     unsigned int nplanes,
+					     const struct texture_stream_plane *planes)
+{
+	struct texture_stream *stream;
+	unsigned int i, j;
+
+	if (!depth || !nplanes || nplanes > TEXTURE_STREAM_MAX_PLANES) {
+		fprintf(stderr, "Invalid texture stream (%d planes, depth %d)\n", nplanes, depth);
+		return NULL;
+	}
+
+	stream = calloc(1, sizeof(*stream));
+	if (!stream) {
+		return NULL;
+	}
+
+	stream->sets = calloc(depth, sizeof(*stream->sets));
+	if (!stream->sets) {
+		free(stream);
+		return NULL;
+	}
+
+	stream->depth = depth;
+	stream->nplanes = nplanes;
+	memcpy(stream->planes, planes, sizeof(*planes) * nplanes);
+	texture_stream_init_fences(stream, display);
+
+	glActiveTexture(GL_TEXTURE0);
+	for (i = 0; i < depth; i++) {
+		struct texture_set *set = &stream->sets[i];
+
+		set->fence = EGL_NO_SYNC_KHR;
+		glGenTextures(nplanes, set->handles);
+		for (j = 0; j < nplanes; j++) {
+			GLenum format = texture_format(planes[j].ncmp);
+
+			glBindTexture(GL_TEXTURE_2D, set->handles[j]);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexImage2D(GL_TEXTURE_2D, 0, format, planes[j].width, planes[j].height,
+				     0, format, GL_UNSIGNED_BYTE, NULL);
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	return stream;
+}
+
+static void texture_set_wait(struct texture_stream *stream, struct texture_set *set)
+{
+	if (set->fence == EGL_NO_SYNC_KHR)
+		return;
+
+	stream->client_wait_sync(stream->display, set->fence,
+				 EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
+	stream->destroy_sync(stream->display, set->fence);
+	set->fence = EGL_NO_SYNC_KHR;
+}
+
+void texture_stream_destroy(struct texture_stream *stream)
+{
+	unsigned int i;
+
+	if (!stream)
+		return;
+
+	for (i = 0; i < stream->depth; i++) {
+		texture_set_wait(stream, &stream->sets[i]);
+		glDeleteTextures(stream->nplanes, stream->sets[i].handles);
+	}
+
+	free(stream->sets);
+	free(stream);
+}
+
+struct texture_set *texture_stream_next(struct texture_stream *stream)
+{
+	struct texture_set *set = &stream->sets[stream->next];
+
+	stream->next = (stream->next + 1) % stream->depth;
+	texture_set_wait(stream, set);
+
+	return set;
+}
+
+int texture_stream_upload(struct texture_stream *stream, struct texture_set *set,
+			  unsigned int plane, const struct texture *tex)
+{
+	struct texture_stream_plane *p;
+
+	if (plane >= stream->nplanes) {
+		fprintf(stderr, "Invalid stream plane %d\n", plane);
+		return -1;
+	}
+	p = &stream->planes[plane];
+
+	if (tex->width != p->width ||
+	    tex->height != p->height || tex->ncmp != p->ncmp) {
+		fprintf(stderr, "Texture doesn't match stream plane %d\n", plane);
+		return -1;
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, set->handles[plane]);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, p->width, p->height,
+			texture_format(p->ncmp), GL_UNSIGNED_BYTE, tex->data);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	return 0;
+}
+
+void texture_stream_release(struct texture_stream *stream, struct texture_set *set)
+{
+	if (!stream->create_sync)
+		return;
+
+	/* The set might be re-used for several frames, keep the newest fence */
+	if (set->fence != EGL_NO_SYNC_KHR)
+		stream->destroy_sync(stream->display, set->fence);
+
+	set->fence = stream->create_sync(stream->display, EGL_SYNC_FENCE_KHR, NULL);
+}
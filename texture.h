@@ -8,6 +8,8 @@
 #include <stdlib.h>
 
 #include <GLES2/gl2.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
 
 struct texture {
 	uint32_t width, height;
@@ -16,8 +18,59 @@ struct texture {
 
 	char *data;
 	GLuint handle;
+
+	/* Set if data points into a (read-only) file mapping rather than the heap */
+	void *map;
+	size_t maplen;
 };
 
 struct texture *texture_load(const char *file);
+void texture_free(struct texture *tex);
+/* Write tex as binary PGM (1 component) or PPM (3, or 4 with alpha dropped) */
+int texture_save(const char *file, const struct texture *tex);
+
+/*
+ * Interleave two single-component textures of the same size into one
+ * two-component texture, e.g. U and V planes into a luminance-alpha UV
+ */
+struct texture *texture_interleave(const struct texture *a, const struct texture *b);
+
+/* Create a GL texture from tex, choosing the format from ncmp */
+GLuint texture_upload(struct texture *tex);
+
+/*
+ * A texture stream is a ring of texture sets for per-frame uploads.
+ * Each frame goes into a set the GPU isn't reading from any more, so
+ * glTexSubImage2D() never has to wait for (or ghost) a texture which is
+ * still in flight. Where EGL_KHR_fence_sync is available a fence is
+ * placed after the last draw using a set, and texture_stream_next()
+ * waits on it; otherwise the ring depth alone has to cover the latency.
+ */
+#define TEXTURE_STREAM_MAX_PLANES 3
+
+struct texture_stream_plane {
+	uint32_t width, height;
+	unsigned int ncmp;
+};
+
+struct texture_stream;
+
+struct texture_set {
+	GLuint handles[TEXTURE_STREAM_MAX_PLANES];
+	EGLSyncKHR fence;
+};
+
+struct texture_stream *texture_stream_create(EGLDisplay display, unsigned int depth,
+					     unsigned int nplanes,
+					     const struct texture_stream_plane *planes);
+void texture_stream_destroy(struct texture_stream *stream);
+
+/* Get the next set in the ring, waiting until the GPU is done with it */
+struct texture_set *texture_stream_next(struct texture_stream *stream);
+/* Upload tex into one plane of set. tex must match the plane's size */
+int texture_stream_upload(struct texture_stream *stream, struct texture_set *set,
+			  unsigned int plane, const struct texture *tex);
+/* Mark set as in flight, once all the draws reading it have been issued */
+void texture_stream_release(struct texture_stream *stream, struct texture_set *set);
 
 #endif /* __TEXTURE_H__ */
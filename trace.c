@@ -0,0 +1,156 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+
+/* Per thread, so 64k events is ~1.5 MiB each */
+#define TRACE_EVENTS 65536
+
+struct trace_ev {
+	const char *name;
+	uint64_t ts;
+	char phase;
+};
+
+struct trace_buf {
+	struct trace_buf *next;
+	pid_t tid;
+	const char *thread_name;
+	/* Total events ever recorded, the ring holds the last TRACE_EVENTS */
+	uint64_t count;
+	struct trace_ev events[TRACE_EVENTS];
+};
+
+bool trace_enabled;
+
+static char trace_path[PATH_MAX];
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_buf *trace_bufs;
+static __thread struct trace_buf *trace_local;
+
+static struct trace_buf *trace_get_buf(void)
+{
+	struct trace_buf *buf = trace_local;
+
+	if (buf)
+		return buf;
+
+	buf = calloc(1, sizeof(*buf));
+	if (!buf)
+		return NULL;
+	buf->tid = syscall(SYS_gettid);
+
+	/* Only taken once per thread */
+	pthread_mutex_lock(&trace_lock);
+	buf->next = trace_bufs;
+	trace_bufs = buf;
+	pthread_mutex_unlock(&trace_lock);
+
+	trace_local = buf;
+	return buf;
+}
+
+void trace_enable(const char *path)
+{
+	snprintf(trace_path, sizeof(trace_path), "%s", path);
+	trace_enabled = true;
+}
+
+void trace_thread_name(const char *name)
+{
+	struct trace_buf *buf;
+
+	if (!trace_enabled)
+		return;
+
+	buf = trace_get_buf();
+	if (buf)
+		buf->thread_name = name;
+}
+
+void trace_event(const char *name, char phase)
+{
+	struct trace_buf *buf = trace_get_buf();
+	struct trace_ev *ev;
+	struct timespec ts;
+
+	if (!buf)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	ev = &buf->events[buf->count % TRACE_EVENTS];
+	ev->name = name;
+	ev->phase = phase;
+	ev->ts = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+	/* Publish after the event, for trace_flush() on another thread */
+	__atomic_store_n(&buf->count, buf->count + 1, __ATOMIC_RELEASE);
+}
+
+static void trace_write_buf(FILE *fp, struct trace_buf *buf, pid_t pid, const char **sep)
+{
+	uint64_t count = __atomic_load_n(&buf->count, __ATOMIC_ACQUIRE);
+	uint64_t i = count > TRACE_EVENTS ? count - TRACE_EVENTS : 0;
+	struct trace_ev *ev;
+
+	if (buf->thread_name) {
+		fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+			"\"args\":{\"name\":\"%s\"}}", *sep, pid, buf->tid, buf->thread_name);
+		*sep = ",\n";
+	}
+
+	/*
+	 * If the thread is still running, the oldest few events may be
+	 * overwritten while we read them. That's fine for a trace.
+	 */
+	for (; i < count; i++) {
+		ev = &buf->events[i % TRACE_EVENTS];
+		fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d%s}",
+			*sep, ev->name, ev->phase, ev->ts / 1000.0, pid, buf->tid,
+			ev->phase == 'i' ? ",\"s\":\"t\"" : "");
+		*sep = ",\n";
+	}
+}
+
+int trace_flush(void)
+{
+	const char *sep = "";
+	struct trace_buf *buf;
+	pid_t pid = getpid();
+	FILE *fp;
+
+	if (!trace_enabled)
+		return 0;
+
+	fp = fopen(trace_path, "w");
+	if (!fp) {
+		fprintf(stderr, "Couldn't open %s: %s\n", trace_path, strerror(errno));
+		return -1;
+	}
+
+	fprintf(fp, "{\"traceEvents\":[\n");
+	pthread_mutex_lock(&trace_lock);
+	for (buf = trace_bufs; buf; buf = buf->next)
+		trace_write_buf(fp, buf, pid, &sep);
+	pthread_mutex_unlock(&trace_lock);
+	fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+	if (fclose(fp)) {
+		fprintf(stderr, "Couldn't write %s: %s\n", trace_path, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
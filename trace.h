@@ -0,0 +1,48 @@
+/*
+ * Copyright Brian Starkey <stark3y@gmail.com> 2017
+ */
+#ifndef __TRACE_H__
+#define __TRACE_H__
+#include <stdbool.h>
+
+/*
+ * Timeline tracing, written out as Chrome trace-event JSON (load it in
+ * chrome://tracing or ui.perfetto.dev).
+ *
+ * Each thread records into its own preallocated ring, so recording is just
+ * a clock read and a store. When a ring fills, the oldest events are
+ * overwritten. Everything is a no-op until trace_enable() is called.
+ *
+ * Names must be string literals (or otherwise outlive the trace).
+ */
+extern bool trace_enabled;
+
+void trace_enable(const char *path);
+/* Name the calling thread in the trace */
+void trace_thread_name(const char *name);
+
+void trace_event(const char *name, char phase);
+
+static inline void trace_begin(const char *name)
+{
+	if (trace_enabled)
+		trace_event(name, 'B');
+}
+
+static inline void trace_end(const char *name)
+{
+	if (trace_enabled)
+		trace_event(name, 'E');
+}
+
+/* A point in time, rather than a span */
+static inline void trace_instant(const char *name)
+{
+	if (trace_enabled)
+		trace_event(name, 'i');
+}
+
+/* Write everything recorded so far to the trace file */
+int trace_flush(void);
+
+#endif /* __TRACE_H__ */
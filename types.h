@@ -3,6 +3,7 @@
  */
 #ifndef __TYPES_H__
 #define __TYPES_H__
+#include <stdbool.h>
 #include <stdint.h>
 
 #include <GLES2/gl2.h>
@@ -15,11 +16,20 @@ struct bind {
 enum uniform_type {
 	UNIFORM_1i = 0,
 	UNIFORM_MAT_F4,
+	UNIFORM_1f,
+	UNIFORM_2f,
+	UNIFORM_MAT_F3,
 };
 
 struct uniform {
 	enum uniform_type type;
-	GLuint handle;
+	GLint handle;
+	/* Needs uploading before the next draw */
+	bool dirty;
+	union {
+		GLint i;
+		GLfloat f[16];
+	} value;
 };
 
 struct fbo {
@@ -35,6 +45,9 @@ struct viewport {
 struct attr {
 	GLuint loc;
 	GLint size;
+	/* 0 for GL_FLOAT */
+	GLenum type;
+	GLboolean normalized;
 	GLsizei stride;
 	GLvoid *ptr;
 };